@@ -0,0 +1,125 @@
+/*-------------------------------------------------------------------
+**
+**  Fichero:
+**    bench-wallpaper.c  17/10/2026
+**
+**    Programacin de Sistemas y Dispositivos
+**    Facultad de Informtica. Universidad Complutense de Madrid
+**
+**  Propsito:
+**    Mide con el timer3 lo que tarda lcd_putWallpaper frente a la
+**    versin original que copiaba el fondo byte a byte
+**
+**  Notas de diseo:
+**    - El fondo es un BMP de 320x240 a 4b/px generado en memoria,
+**      as la medida no depende de ningn fichero cargado en la placa
+**    - La versin original escribe en un buffer propio del mismo
+**      tamao que el del LCD para no alterar lo que se ve
+**    - Los tiempos se muestran por la UART0 en dcimas de ms
+**
+**-----------------------------------------------------------------*/
+
+#include <s3c44b0x.h>
+#include <s3cev40.h>
+#include <common_types.h>
+#include <system.h>
+#include <uart.h>
+#include <timers.h>
+#include <lcd.h>
+
+#define BMP_HEADER  (118)                    /* Cabecera + paleta de 16 colores */
+#define BMP_SIZE    (BMP_HEADER + LCD_WIDTH*LCD_HEIGHT/2)
+#define REPS        (20)
+
+static uint8 bmp[BMP_SIZE] __attribute__ ((aligned (4)));
+static uint8 buffer[LCD_WIDTH*LCD_HEIGHT/2] __attribute__ ((aligned (4)));
+
+void bmp_make( void );
+void putWallpaper_byte( uint8 *bmp, uint8 *dst );
+void report( char *name, uint32 time );
+
+/*******************************************************************/
+
+void main( void )
+{
+    uint16 i;
+    uint32 timeByte, timeWord;
+
+    sys_init();
+    timers_init();
+    uart0_init();
+    lcd_init();
+    lcd_clear();
+    lcd_on();
+
+    uart0_puts( "\n\n Medida de lcd_putWallpaper (dcimas de ms por llamada)\n" );
+    uart0_puts( " ------------------------------------------------------\n\n" );
+
+    bmp_make();
+
+    timer3_start();
+    for( i=0; i<REPS; i++ )
+        putWallpaper_byte( bmp, buffer );
+    timeByte = timer3_stop();
+
+    timer3_start();
+    for( i=0; i<REPS; i++ )
+        lcd_putWallpaper( bmp );
+    timeWord = timer3_stop();
+
+    report( "  Byte a byte (original): ", timeByte );
+    report( "  lcd_putWallpaper:       ", timeWord );
+    uart0_puts( "  Aceleracin (x10):      " );
+    uart0_putint( timeWord ? (10*timeByte) / timeWord : 0 );
+    uart0_puts( "\n" );
+
+    while( 1 );
+}
+
+/*******************************************************************/
+
+/*
+** Genera un BMP de 4b/px con franjas verticales de los 16 niveles de gris
+*/
+void bmp_make( void )
+{
+    uint32 i;
+
+    for( i=0; i<BMP_HEADER; i++ )
+        bmp[i] = 0;
+    bmp[0]  = 'B';
+    bmp[1]  = 'M';
+    bmp[10] = BMP_HEADER;
+    for( i=BMP_HEADER; i<BMP_SIZE; i++ )
+        bmp[i] = (((i / 10) & 0xf) << 4) | ((i / 10) & 0xf);
+}
+
+/*
+** Copia del lcd_putWallpaper original: invierte filas y pxeles byte a byte
+*/
+void putWallpaper_byte( uint8 *bmp, uint8 *dst )
+{
+    uint32 headerSize;
+    uint16 x, ySrc, yDst;
+    uint16 offsetSrc, offsetDst;
+
+    headerSize = bmp[10] + (bmp[11] << 8) + (bmp[12] << 16) + (bmp[13] << 24);
+    bmp = bmp + headerSize;
+
+    for( ySrc=0, yDst=LCD_HEIGHT-1; ySrc<LCD_HEIGHT; ySrc++, yDst-- )
+    {
+        offsetDst = yDst*LCD_WIDTH/2;
+        offsetSrc = ySrc*LCD_WIDTH/2;
+        for( x=0; x<LCD_WIDTH/2; x++ )
+            dst[offsetDst+x] = ~bmp[offsetSrc+x];
+    }
+}
+
+void report( char *name, uint32 time )
+{
+    uart0_puts( name );
+    uart0_putint( time / REPS );
+    uart0_puts( "," );
+    uart0_putint( (10*time / REPS) % 10 );
+    uart0_puts( "\n" );
+}
@@ -9,9 +9,13 @@
 **
 **  Propsito:
 **    Contiene las definiciones de los prototipos de funciones
-**    para la inicializacin del controlador BDMA0
+**    para la inicializacin del controlador BDMA0 y para el servicio
+**    de copia/relleno memoria a memoria por los canales ZDMA0/ZDMA1
 **
 **  Notas de diseo:
+**    - Las transferencias ZDMA se encolan por canal y se lanzan por
+**      software en modo whole service; la RTI del canal invoca el
+**      callback de la transferencia terminada y lanza la siguiente
 **
 **-----------------------------------------------------------------*/
 
@@ -20,6 +24,21 @@
 
 #include <common_types.h>
 
+#define ZDMA0       (0)
+#define ZDMA1       (1)
+#define ZDMA_NONE   (0xff)
+
+/*
+** Tamao del dato por transferencia
+*/
+#define ZDMA_8BIT   (0)
+#define ZDMA_16BIT  (1)
+#define ZDMA_32BIT  (2)
+#define ZDMA_BURST  (3)     /* palabras en rfagas de 4 (longitud mltiplo de 16 bytes) */
+
+#define ZDMA_QUEUE_LEN  (8)         /* peticiones pendientes por canal */
+#define ZDMA_MAX_COUNT  (0xfffff)   /* bytes mximos por peticin */
+
 /* 
 ** Inicializa a 0 los registros de control del canal BDMA0
 */
@@ -38,4 +57,42 @@ void bdma0_open( void (*isr)(void) );
 */
 void bdma0_close( void );
 
+/*
+** Para ambos canales ZDMA y vaca sus colas de peticiones
+** Instala las RTI de ZDMA0 y ZDMA1, borra interrupciones pendientes y las desenmascara
+*/
+void zdma_init( void );
+
+/*
+** Reserva en exclusiva un canal ZDMA libre y lo devuelve (ZDMA_NONE si no quedan)
+*/
+uint8 zdma_alloc( void );
+
+/*
+** Libera un canal ZDMA reservado, esperando a que termine sus peticiones pendientes
+** Ignora los canales invlidos (p.ej. ZDMA_NONE)
+*/
+void zdma_free( uint8 ch );
+
+/*
+** Encola en el canal indicado la copia de n bytes de src a dst con el tamao de dato indicado
+** Las direcciones y n deben estar alineados al tamao de dato
+** Al terminar se llama a callback (si no es NULL) desde la RTI del canal
+** Devuelve FALSE si la cola del canal est llena o la peticin no es vlida
+*/
+boolean zdma_memcpy( uint8 ch, void *dst, const void *src, uint32 n, uint8 size, void (*callback)(void) );
+
+/*
+** Encola en el canal indicado el relleno de n bytes a partir de dst con el patrn indicado
+** (se usan los 8/16/32 bits menos significativos del patrn segn el tamao de dato)
+** Al terminar se llama a callback (si no es NULL) desde la RTI del canal
+** Devuelve FALSE si la cola del canal est llena o la peticin no es vlida
+*/
+boolean zdma_memset( uint8 ch, void *dst, uint32 pattern, uint32 n, uint8 size, void (*callback)(void) );
+
+/*
+** Devuelve TRUE si el canal tiene alguna peticin en curso o pendiente (FALSE si el canal no es vlido)
+*/
+boolean zdma_busy( uint8 ch );
+
 #endif
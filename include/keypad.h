@@ -50,7 +50,7 @@
 
 /*
 ** Inicializa el keypad
-** Inicializa timers
+** La aplicacin debe haber llamado antes a timers_init
 */
 void keypad_init( void );
 
@@ -79,6 +79,14 @@ uint8 keypad_getchartime( uint16 *ms );
 */
 uint8 keypad_timeout_getchar( uint16 ms );
 
+/* 
+** Versin no bloqueante de keypad_getchar: vuelve enseguida y, tras la presin y depresin de una tecla,
+** llama a callback con su scancode desde la RTI del timer5 (solo con KEYPAD_IO_METHOD == POOLING)
+** Los retardos de rebote no bloquean; mientras tanto el keypad se muestrea cada 10 ms
+** Una nueva llamada sustituye a la peticin en curso
+*/ 
+void keypad_getchar_async( void (*callback)( uint8 scancode ) );
+
 /* 
 ** Instala, en la tabla de vectores de interrupcin, la funcin isr como RTI de interrupciones por presin del keypad
 ** Borra interrupciones pendientes por presin del keypad
@@ -19,11 +19,136 @@
 #define __LCD_H__
 
 #include <common_types.h>
+#include <fix_types.h>
 
 #define LCD_WIDTH   (320)
 #define LCD_HEIGHT  (240)
 
 #define LCD_BUFFER_SIZE    (LCD_WIDTH*LCD_HEIGHT/2) // en bytes con 2 pixels/byte
+#define LCD_VIRTUAL_SIZE   (2*LCD_BUFFER_SIZE)      // bytes mximos de una pantalla virtual (ocupa los dos buffers)
+
+#define LCD_SINGLE_BUFFER  (0)    // se dibuja sobre el buffer visible
+#define LCD_DOUBLE_SWAP    (1)    // lcd_flip intercambia los buffers
+#define LCD_DOUBLE_COPY    (2)    // lcd_flip intercambia los buffers y copia lo modificado del visible en el oculto
+#define LCD_OFFSCREEN      (3)    // se dibuja fuera de pantalla y lcd_flip/lcd_flush vuelcan lo modificado al visible
+
+#define LCD_MONO           (1)    // profundidades del buffer que barre el controlador (bits por pixel)
+#define LCD_GRAY4          (2)
+#define LCD_GRAY16         (4)
+
+#define LCD_DIRTY_TILE     (8)    // lado en pixeles de las teselas con las que se registran las zonas modificadas
+#define LCD_DIRTY_COLS     (LCD_WIDTH/LCD_DIRTY_TILE)
+#define LCD_DIRTY_ROWS     (LCD_HEIGHT/LCD_DIRTY_TILE)
+
+#define LCD_GLYPH_CACHE_X1 (64)   // entradas (potencia de 2) de la cache de glifos expandidos a escala 1
+#define LCD_GLYPH_CACHE_X2 (32)   // entradas (potencia de 2) de la cache de glifos expandidos a escala 2
+#define LCD_TEXT_CACHE     (16384)    // bytes de la cache LRU de cadenas ya pintadas por lcd_puts/lcd_puts_x2
+#define LCD_TEXT_RUNS      (16)       // cadenas distintas en la cache de cadenas
+#define LCD_TEXT_LEN       (40)       // longitud mxima de una cadena que se guarda en la cache
+
+#define LCD_FIX_Q          (4)    // bits decimales de las coordenadas de lcd_draw_line, elipses y polgonos
+#define LCD_FIX(i)         ((fix32)(i) << LCD_FIX_Q)
+#define LCD_FIX_HALF       (1 << (LCD_FIX_Q-1))
+#define LCD_POLYGON_VERTICES (16) // vrtices mximos de lcd_fill_polygon
+
+#define LCD_BITMAP_MAGIC   (0x34525053)    // "SPR4"
+#define LCD_BITMAP_RAW     (0)             // filas sin comprimir
+#define LCD_BITMAP_RLE     (1)             // filas comprimidas por repeticiones de bytes (ver lcd_bitmap_t)
+
+/*
+** Bitmap en formato nativo generado en el PC por tools/bmp2spr a partir de un BMP
+** Las filas estn ordenadas de arriba a abajo, alineadas a palabra y con los colores ya invertidos
+** En formato LCD_BITMAP_RLE las height*stride bytes de las filas forman un nico flujo de paquetes:
+**   0ccccccc seguido de c+1 bytes literales
+**   1ccccccc seguido de un byte que se repite c+2 veces
+** Los paquetes pueden cruzar el final de una fila
+*/
+typedef struct {
+    uint32 magic;       // LCD_BITMAP_MAGIC
+    uint16 width;       // anchura en pixeles
+    uint16 height;      // altura en pixeles
+    uint16 stride;      // bytes por fila (mltiplo de 4)
+    uint16 format;      // LCD_BITMAP_RAW o LCD_BITMAP_RLE
+    uint8  data[];      // height filas de stride bytes a 4b/px (comprimidas si el formato es LCD_BITMAP_RLE)
+} lcd_bitmap_t;
+
+#define LCD_ANIM_MAGIC     (0x34494e41)    // "ANI4"
+
+/*
+** Animacin generada por tools/bmp2spr -a: una keyframe sin comprimir seguida de frames deltas
+** El delta i transforma el frame i en el (i+1) % frames, por lo que la animacin se repite en bucle
+** Cada delta es una secuencia de spans de bytes que cambian en una fila, terminada por un span vaco:
+**   fila (2 bytes, little-endian), byte inicial de la fila, nmero de bytes n y n bytes a 4b/px
+*/
+typedef struct {
+    uint32 magic;       // LCD_ANIM_MAGIC
+    uint16 width;       // anchura en pixeles
+    uint16 height;      // altura en pixeles
+    uint16 stride;      // bytes por fila de la keyframe (mltiplo de 4)
+    uint16 frames;      // nmero de frames (incluida la keyframe)
+    uint8  data[];      // height filas de stride bytes seguidas de los frames deltas
+} lcd_anim_t;
+
+/*
+** Reproductor de una animacin: recuerda dnde se muestra y cul es el siguiente delta
+*/
+typedef struct {
+    lcd_anim_t *anim;
+    uint16 x, y;
+    uint16 frame;           // frame que hay en pantalla
+    const uint8 *delta;     // delta que lo transforma en el siguiente
+} lcd_player_t;
+
+/*
+** Superficie de dibujo de 4b/px: la pantalla (lcd_screen) o un buffer fuera de ella
+** Todas las primitivas dibujan sobre la superficie seleccionada con lcd_target y se recortan,
+** una sola vez por llamada, al rectngulo [cx0,cx1)x[cy0,cy1)
+*/
+typedef struct {
+    uint8 *base;            // primera fila (alineada a palabra)
+    uint16 width, height;   // en pixeles
+    uint32 stride;          // bytes por fila (mltiplo de 4)
+    uint16 cx0, cy0;        // rectngulo de recorte: esquina superior izquierda (incluida)...
+    uint16 cx1, cy1;        // ... e inferior derecha (excluida)
+} lcd_surface_t;
+
+#define LCD_ROT_0          (0)    // orientaciones de un bitmap: giro en sentido horario...
+#define LCD_ROT_90         (1)
+#define LCD_ROT_180        (2)
+#define LCD_ROT_270        (3)
+#define LCD_MIRROR_H       (4)    // ... combinable con espejo horizontal (tras el giro)
+#define LCD_MIRROR_V       (8)    // ... o vertical
+
+#define LCD_FIELD_DIGITS   (10)   // celdas mximas de un campo numrico
+
+/*
+** Campo numrico retenido: recuerda los caracteres pintados en cada celda para redibujar solo los que cambian
+** El nmero se alinea a la derecha en width celdas de 8*scale pxeles de ancho
+*/
+typedef struct {
+    uint16 x, y;                    // esquina superior izquierda del campo
+    uint8 color;
+    uint8 width;                    // celdas (1..LCD_FIELD_DIGITS)
+    char fill;                      // relleno a la izquierda de las cifras (' ' o '0')
+    uint8 scale;                    // 1 (8x16) o 2 (16x32)
+    char shown[LCD_FIELD_DIGITS];   // carcter pintado en cada celda ('\0' = sin pintar)
+} lcd_field_t;
+
+#define LCD_FIELD( x, y, color, width, fill, scale )   { (x), (y), (color), (width), (fill), (scale), { 0 } }
+
+#define LCD_SPRITES           (32)      // sprites simultneos
+#define LCD_SPRITE_MASKS      (16)      // bitmaps distintos con mscara precalculada
+#define LCD_SPRITE_MASK_POOL  (16384)   // bytes reservados para mscaras
+#define LCD_SPRITE_DAMAGE     (16)      // zonas daadas independientes entre dos lcd_sprites_render
+#define LCD_SPRITE_NONE       (0xff)
+#define LCD_NO_KEY            (0xff)    // sin color transparente
+
+#define LCD_CONSOLE_COLS      (LCD_WIDTH/8)     // columnas de la consola (fuente 8x16)
+#define LCD_CONSOLE_ROWS      (LCD_HEIGHT/16)   // filas de texto visibles de la consola
+#define LCD_CONSOLE_HISTORY   (64)      // lneas que guarda la consola para lcd_console_scrollback
+
+#define LCD_DL_COMMANDS       (64)      // rdenes de dibujo por frame en la lista de visualizacin
+#define LCD_DL_TEXT           (512)     // bytes para las cadenas copiadas en la lista
 
 #define BLACK       (0xf)
 #define WHITE       (0x0)
@@ -63,11 +188,111 @@ void lcd_off( void );
 */
 uint8 lcd_status( void );
 
+/*
+** Selecciona el modo de buffering (LCD_SINGLE_BUFFER/LCD_DOUBLE_SWAP/LCD_DOUBLE_COPY/LCD_OFFSCREEN)
+** En los modos de doble buffer todas las primitivas dibujan sobre el buffer oculto,
+** que se inicializa con el contenido del visible
+** Todas las primitivas registran las teselas que modifican
+*/
+void lcd_buffering( uint8 mode );
+
+/*
+** Selecciona la profundidad con la que el controlador lee la pantalla (LCD_MONO/LCD_GRAY4/LCD_GRAY16)
+** Con LCD_MONO o LCD_GRAY4 se sigue dibujando a 16 grises fuera de pantalla (modo LCD_OFFSCREEN, que no
+** puede cambiarse) y lcd_flip/lcd_flush vuelcan lo modificado conservando los bits ms significativos del color
+** Se conserva la imagen dibujada; al volver a LCD_GRAY16 se restaura el modo de buffering que haba antes del cambio
+** Devuelve FALSE si la profundidad no es vlida o hay una pantalla virtual
+*/
+boolean lcd_depth( uint8 bpp );
+
+/*
+** Define una pantalla virtual de width*height pxeles (width mltiplo de 8) de la que el panel muestra una ventana
+** Solo admite LCD_SINGLE_BUFFER a 16 grises; las primitivas de dibujo trabajan en coordenadas de la pantalla virtual,
+** mientras que el fondo y los sprites se limitan a su esquina de LCD_WIDTH*LCD_HEIGHT
+** Con (LCD_WIDTH, LCD_HEIGHT) se recupera la pantalla normal. El contenido previo no se conserva
+** Devuelve FALSE si las dimensiones no son vlidas o no caben en LCD_VIRTUAL_SIZE
+*/
+boolean lcd_virtual( uint16 width, uint16 height );
+
+/*
+** Muestra la ventana de la pantalla virtual cuya esquina superior izquierda es (x,y) (x se redondea a mltiplo de 4)
+** Solo reprograma LCDSADDR1/2/3 al comienzo de un frame, sin copiar ningn pixel
+*/
+void lcd_pan( uint16 x, uint16 y );
+
+/*
+** Hace visible el buffer oculto reprogramando LCDSADDR1/LCDSADDR2 al comienzo de un frame
+** En LCD_DOUBLE_COPY copia adems en el oculto las teselas modificadas del nuevo buffer visible
+** En LCD_OFFSCREEN equivale a lcd_flush
+** En LCD_SINGLE_BUFFER solo olvida las teselas modificadas
+*/
+void lcd_flip( void );
+
+/*
+** Copia del buffer de dibujo al visible solo las teselas modificadas desde el ltimo flip/flush
+*/
+void lcd_flush( void );
+
+/*
+** Inicializa una superficie sobre la memoria indicada (alineada a palabra, stride mltiplo de 4) sin recorte
+*/
+void lcd_surface_init( lcd_surface_t *surface, uint8 *base, uint16 width, uint16 height, uint32 stride );
+
+/*
+** Devuelve la superficie de la pantalla (sigue al buffer de dibujo en los modos de doble buffer)
+*/
+lcd_surface_t *lcd_screen( void );
+
+/*
+** Selecciona la superficie sobre la que dibujan todas las primitivas (NULL = pantalla)
+** Solo se registran teselas modificadas al dibujar sobre la pantalla
+*/
+void lcd_target( lcd_surface_t *surface );
+
+/*
+** Fija el rectngulo de recorte de la superficie de dibujo (acotado a sus dimensiones)
+*/
+void lcd_clip( uint16 x, uint16 y, uint16 xsize, uint16 ysize );
+
+/*
+** Elimina el recorte de la superficie de dibujo
+*/
+void lcd_unclip( void );
+
+/*
+** Copia la superficie indicada en la posicin (x,y) de la de dibujo
+*/
+void lcd_putSurface( lcd_surface_t *surface, uint16 x, uint16 y );
+
 /*
 ** Borra el LCD
 */
 void lcd_clear( void );
 
+/*
+** Pone todo el LCD en el color indicado
+** Solo afecta al rectngulo de recorte de la superficie de dibujo
+*/
+void lcd_clear_color( uint8 color );
+
+/*
+** Borra una porcin de la pantalla de tamao (xsize, ysize) pxeles desde la posicin (x,y)
+** Esta funcin es una generalizacin de lcd_clear
+*/
+void lcd_clearWindow( uint16 x, uint16 y, uint16 xsize, uint16 ysize );
+
+/*
+** Guarda una copia del bitmap indicado, ya con el formato de la pantalla, como fondo activo (NULL = fondo blanco)
+** No dibuja nada
+*/
+void lcd_setBackground( lcd_bitmap_t *bmp );
+
+/*
+** Restaura el fondo activo en una porcin de la pantalla de tamao (xsize, ysize) pxeles desde la posicin (x,y)
+** Es la alternativa a lcd_clearWindow para borrar un grfico pintado sobre el fondo
+*/
+void lcd_restoreWindow( uint16 x, uint16 y, uint16 xsize, uint16 ysize );
+
 /*
 ** Pone el pixel (x,y) en el color indicado
 */
@@ -93,6 +318,42 @@ void lcd_draw_vline( uint16 yup, uint16 ydown, uint16 x, uint8 color, uint16 wid
 */
 void lcd_draw_box( uint16 xleft, uint16 yup, uint16 xright, uint16 ydown, uint8 color, uint16 width );
 
+/*
+** Rellena del color indicado el rectngulo cuya esquina superior izquierda est en el pixel (xleft,yup) y cuya esquina inferior est en el pxel (xright, ydown)
+*/
+void lcd_fill_box( uint16 xleft, uint16 yup, uint16 xright, uint16 ydown, uint8 color );
+
+/*
+** Dibuja una lnea de 1 pixel de grosor entre dos puntos en punto fijo (Q LCD_FIX_Q, el centro del pixel (x,y) es (x+0.5,y+0.5))
+** Los extremos pueden quedar fuera de la pantalla; se pinta por spans horizontales recortados
+*/
+void lcd_draw_line( fix32 x0, fix32 y0, fix32 x1, fix32 y1, uint8 color );
+
+/*
+** Dibuja el contorno de la elipse de centro (xc,yc) y semiejes rx, ry alineados con los ejes (Q LCD_FIX_Q)
+*/
+void lcd_draw_ellipse( fix32 xc, fix32 yc, fix32 rx, fix32 ry, uint8 color );
+
+/*
+** Rellena la elipse de centro (xc,yc) y semiejes rx, ry (Q LCD_FIX_Q): pinta los pixeles cuyo centro queda dentro
+*/
+void lcd_fill_ellipse( fix32 xc, fix32 yc, fix32 rx, fix32 ry, uint8 color );
+
+/*
+** Dibuja el contorno de la circunferencia de centro (xc,yc) y radio r (Q LCD_FIX_Q)
+*/
+void lcd_draw_circle( fix32 xc, fix32 yc, fix32 r, uint8 color );
+
+/*
+** Rellena el crculo de centro (xc,yc) y radio r (Q LCD_FIX_Q)
+*/
+void lcd_fill_circle( fix32 xc, fix32 yc, fix32 r, uint8 color );
+
+/*
+** Rellena el polgono convexo de n vrtices (3 a LCD_POLYGON_VERTICES) dados como pares x,y consecutivos en Q LCD_FIX_Q
+*/
+void lcd_fill_polygon( const fix32 *xy, uint8 n, uint8 color );
+
 /*
 ** Usando una fuente 8x16, escribe un caracter a partir del pixel (x,y) en el color indicado
 */
@@ -100,6 +361,7 @@ void lcd_putchar( uint16 x, uint16 y, uint8 color, char ch );
 
 /*
 ** Usando una fuente 8x16, escribe una cadena a partir del pixel (x,y) en el color indicado
+** Las cadenas de 2 a LCD_TEXT_LEN caracteres se guardan ya pintadas en una cache LRU y al repetirse se copian de un solo blit
 */
 void lcd_puts( uint16 x, uint16 y, uint8 color, char *s );
 
@@ -120,6 +382,7 @@ void lcd_putchar_x2( uint16 x, uint16 y, uint8 color, char ch );
 
 /*
 ** Usando una fuente 8x16, escribe una cadena a doble tamao a partir del pixel (x,y) en el color indicado
+** Comparte con lcd_puts la cache de cadenas
 */
 void lcd_puts_x2( uint16 x, uint16 y, uint8 color, char *s );
 
@@ -138,4 +401,177 @@ void lcd_puthex_x2( uint16 x, uint16 y, uint8 color, uint32 i );
 */
 void lcd_putWallpaper( uint8 *bmp );
 
+/*
+** Muestra un BMP de tamao (xsize, ysize) pxeles y 16b/px en la posicin (x,y)
+** La posicin x puede ser impar; la copia se realiza por palabras (8 pxeles por acceso)
+*/
+void lcd_putBmp( uint8 *bmp, uint16 x, uint16 y, uint16 xsize, uint16 ysize );
+
+/*
+** Comprueba que en la direccin indicada hay un bitmap en formato nativo y lo devuelve (NULL si no lo es)
+*/
+lcd_bitmap_t *lcd_loadBitmap( uint8 *addr );
+
+/*
+** Muestra un bitmap en formato nativo en la posicin (x,y) mediante una copia directa por palabras
+** Los bitmaps comprimidos se descomprimen directamente sobre la pantalla, sin buffer intermedio
+*/
+void lcd_putBitmap( lcd_bitmap_t *bmp, uint16 x, uint16 y );
+
+/*
+** Comprueba que en la direccin indicada hay una animacin en formato nativo y la devuelve (NULL si no lo es)
+*/
+lcd_anim_t *lcd_loadAnim( uint8 *addr );
+
+/*
+** Asocia la animacin al reproductor y pinta entera su keyframe en la posicin (x,y)
+*/
+void lcd_anim_start( lcd_player_t *player, lcd_anim_t *anim, uint16 x, uint16 y );
+
+/*
+** Avanza al siguiente frame reescribiendo solo los spans que cambian (vuelve a la keyframe tras el ltimo)
+** Supone que la zona de la animacin no se ha pintado desde el frame anterior
+*/
+void lcd_anim_step( lcd_player_t *player );
+
+/*
+** Muestra un bitmap sin comprimir en la posicin (x,y) con la orientacin indicada (LCD_ROT_* | LCD_MIRROR_*)
+** Con giros de 90/270 grados la anchura y altura en pantalla quedan intercambiadas
+*/
+void lcd_putBitmapOrient( lcd_bitmap_t *bmp, uint16 x, uint16 y, uint8 orient );
+
+/*
+** Inicializa un campo numrico (equivalente al inicializador esttico LCD_FIELD)
+** Debe volver a llamarse si la zona del campo se ha borrado para que se pinte entero en la siguiente escritura
+*/
+void lcd_field_init( lcd_field_t *field, uint16 x, uint16 y, uint8 color, uint8 width, char fill, uint8 scale );
+
+/*
+** Muestra el entero indicado en el campo redibujando solo las celdas cuyo carcter cambia
+** Si no cabe se muestran sus cifras menos significativas (en los negativos, una menos para dejar sitio al signo)
+*/
+void lcd_field_putint( lcd_field_t *field, int32 i );
+
+/*
+** Elimina todos los sprites, fija el bitmap de fondo sobre el que se componen (NULL = blanco) y lo dibuja
+*/
+void lcd_sprites_init( lcd_bitmap_t *background );
+
+/*
+** Crea un sprite visible con el bitmap indicado en la posicin (x,y) y con profundidad z (mayor z, ms arriba)
+** Los pixeles del color key son transparentes (LCD_NO_KEY para un sprite opaco); su mscara se precalcula
+** El bitmap debe estar sin comprimir (el fondo puede estar comprimido)
+** Devuelve su identificador o LCD_SPRITE_NONE si no quedan libres o el bitmap est comprimido
+*/
+uint8 lcd_sprite_add( lcd_bitmap_t *bmp, uint16 x, uint16 y, uint8 z, uint8 key );
+
+/*
+** Elimina el sprite indicado
+*/
+void lcd_sprite_remove( uint8 id );
+
+/*
+** Mueve el sprite indicado a la posicin (x,y)
+*/
+void lcd_sprite_move( uint8 id, uint16 x, uint16 y );
+
+/*
+** Cambia el bitmap del sprite indicado (se ignora si el nuevo bitmap est comprimido)
+*/
+void lcd_sprite_set( uint8 id, lcd_bitmap_t *bmp );
+
+/*
+** Cambia la orientacin (LCD_ROT_* | LCD_MIRROR_*) con la que se pinta el sprite indicado; la posicin no vara
+*/
+void lcd_sprite_orient( uint8 id, uint8 orient );
+
+/*
+** Muestra (TRUE) u oculta (FALSE) el sprite indicado
+*/
+void lcd_sprite_show( uint8 id, boolean visible );
+
+/*
+** Recompone las zonas afectadas por los cambios de los sprites desde la ltima llamada
+*/
+void lcd_sprites_render( void );
+
+/*
+** Aade a la lista de visualizacin una caja como la de lcd_draw_box; no se pinta hasta lcd_dl_render
+** Si la lista est llena la orden se descarta (esto vale para todas las lcd_dl_*)
+*/
+void lcd_dl_draw_box( uint16 xleft, uint16 yup, uint16 xright, uint16 ydown, uint8 color, uint16 width );
+
+/*
+** Aade a la lista de visualizacin un rectngulo relleno como el de lcd_fill_box
+*/
+void lcd_dl_fill_box( uint16 xleft, uint16 yup, uint16 xright, uint16 ydown, uint8 color );
+
+/*
+** Aade a la lista de visualizacin una cadena a escala 1; la cadena se copia y puede reutilizarse tras la llamada
+*/
+void lcd_dl_puts( uint16 x, uint16 y, uint8 color, char *s );
+
+/*
+** Aade a la lista de visualizacin una cadena a escala 2
+*/
+void lcd_dl_puts_x2( uint16 x, uint16 y, uint8 color, char *s );
+
+/*
+** Aade a la lista de visualizacin un entero en hexadecimal a escala 1
+*/
+void lcd_dl_puthex( uint16 x, uint16 y, uint8 color, uint32 i );
+
+/*
+** Aade a la lista de visualizacin un bitmap con la orientacin indicada (LCD_ROT_0 admite bitmaps comprimidos)
+** Solo se guarda el puntero: el bitmap debe seguir existiendo hasta lcd_dl_render
+*/
+void lcd_dl_putBitmap( lcd_bitmap_t *bmp, uint16 x, uint16 y, uint8 orient );
+
+/*
+** Ejecuta en una sola pasada las rdenes aadidas desde la ltima llamada y vaca la lista
+** Se omiten las rdenes repetidas ms adelante y las que tapa por completo una orden opaca posterior
+*/
+void lcd_dl_render( void );
+
+/*
+** Convierte la pantalla en una consola de texto de LCD_CONSOLE_COLS x LCD_CONSOLE_ROWS caracteres en el color indicado
+** Usa una pantalla virtual de doble altura (ver lcd_virtual) y desplaza el texto reprogramando la direccin
+** de comienzo del panel, sin copiar pixeles; se abandona con lcd_virtual( LCD_WIDTH, LCD_HEIGHT )
+** Devuelve FALSE si no se puede crear la pantalla virtual
+*/
+boolean lcd_console_init( uint8 color );
+
+/*
+** Borra la consola y lleva el cursor a la esquina superior izquierda
+*/
+void lcd_console_clear( void );
+
+/*
+** Escribe un caracter en la posicin del cursor y lo avanza
+** Interpreta '\n' (nueva lnea), '\r' (principio de lnea), '\b' (retroceso con borrado) y '\t' (tabulador cada 8 columnas)
+** Al llegar al final de una lnea o de la pantalla contina en la siguiente, desplazando el texto hacia arriba
+*/
+void lcd_console_putchar( char ch );
+
+/*
+** Escribe una cadena en la consola
+*/
+void lcd_console_puts( char *s );
+
+/*
+** Escribe en la consola un entero en decimal
+*/
+void lcd_console_putint( int32 i );
+
+/*
+** Escribe en la consola un entero en hexadecimal
+*/
+void lcd_console_puthex( uint32 i );
+
+/*
+** Muestra el texto desplazado el nmero de lneas indicado hacia atrs en la historia (0 = ltimas lneas)
+** La siguiente escritura vuelve a mostrar las ltimas lneas
+*/
+void lcd_console_scrollback( uint16 lines );
+
 #endif 
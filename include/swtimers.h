@@ -0,0 +1,104 @@
+/*-------------------------------------------------------------------
+**
+**  Fichero:
+**    swtimers.h  17/10/2026
+**
+**    Programacin de Sistemas y Dispositivos
+**    Facultad de Informtica. Universidad Complutense de Madrid
+**
+**  Propsito:
+**    Contiene las definiciones de los prototipos de las funciones
+**    para la gestin de temporizadores software multiplexados sobre
+**    un nico temporizador hardware (timer5)
+**
+**  Notas de diseo:
+**    - Rueda de tiempo jerrquica: un nivel de 256 ranuras de 1 tick
+**      y 4 niveles de 64 ranuras que cubren los 32 bits de la cuenta;
+**      arrancar, parar y vencer un temporizador cuesta O(1) y la RTI
+**      solo recorre los que vencen en el tick actual
+**    - Los temporizadores los reserva quien los usa (no hay lmite
+**      en su nmero) y deben permanecer en memoria mientras estn
+**      en marcha
+**    - Las funciones de vencimiento se ejecutan dentro de la RTI del
+**      timer5: deben ser breves y no pueden esperar
+**    - En modo sin tick el timer5 solo interrumpe cuando vence algn
+**      temporizador (o cada 64 ms como mucho) y el tiempo se mide con
+**      el reloj del timer4
+**
+**-----------------------------------------------------------------*/
+
+#ifndef __SWTIMERS_H__
+#define __SWTIMERS_H__
+
+#include <common_types.h>
+#include <timers.h>
+
+/*
+** Ticks por segundo (el tick es de 1 ms)
+*/
+#define SWTIMERS_TPS (1000)
+
+/*
+** Temporizador software; sus campos son privados del mdulo
+*/
+typedef struct swtimer {
+    struct swtimer *next;
+    struct swtimer **pprev;         // NULL si est parado
+    uint32 expires;                 // tick en que vence
+    uint32 period;                  // 0 para los de un solo disparo
+    void (*callback)( void *arg );
+    void *arg;
+} swtimer_t;
+
+/*
+** Reserva el timer5 para los temporizadores software, que generar SWTIMERS_TPS interrupciones por segundo
+** Usa el preescalador de los timers 4 y 5 (N=3+1, el mismo que timer4_open_clock) con el divisor 1/16
+** El timer5 no se arranca (ni interrumpe) hasta el primer swtimer_start, que llama a esta funcin si hace falta
+** Las llamadas siguientes no hacen nada
+** Devuelve el resultado de reservar el timer5 (TIMER_OK o el error, en cuyo caso no lo configura)
+*/
+uint8 swtimers_init( void );
+
+/*
+** Activa (TRUE) o desactiva (FALSE) el modo sin tick: en vez de interrumpir cada ms, el timer5 se programa
+** para el vencimiento ms prximo y al despertar se procesan todos los ticks transcurridos
+** Requiere que el reloj del timer4 est abierto (timer4_open_clock); sleep() reprograma el timer5 antes de pasar a IDLE
+** Puede llamarse antes de arrancar el primer temporizador
+*/
+void swtimers_tickless( boolean on );
+
+/*
+** Devuelve los ticks (ms) transcurridos desde que se arranc el primer temporizador
+*/
+uint32 swtimers_ticks( void );
+
+/*
+** Prepara el temporizador t (parado) para que al vencer llame a callback(arg); con callback NULL no llama a nada
+** No debe llamarse sobre un temporizador en marcha (su ranura seguira apuntndolo): antes hay que pararlo
+*/
+void swtimer_init( swtimer_t *t, void (*callback)( void *arg ), void *arg );
+
+/*
+** Arranca (o rearranca) el temporizador t para que venza dentro de ms milisegundos, como mnimo
+** En modo TIMER_INTERVAL vuelve a vencer cada ms milisegundos sin acumular deriva (ms debe ser > 0)
+** Puede llamarse desde tareas y desde RTIs, incluidas las funciones de vencimiento
+*/
+void swtimer_start( swtimer_t *t, uint32 ms, uint8 mode );
+
+/*
+** Para el temporizador t si estaba en marcha
+*/
+void swtimer_stop( swtimer_t *t );
+
+/*
+** Retardo no bloqueante: arranca t sin funcin de vencimiento para que venza dentro de ms milisegundos
+** El retardo ha terminado cuando swtimer_active(t) devuelve FALSE; como swtimer_init, t debe estar parado
+*/
+void swtimer_delay( swtimer_t *t, uint32 ms );
+
+/*
+** Indica si el temporizador t est en marcha
+*/
+boolean swtimer_active( swtimer_t *t );
+
+#endif
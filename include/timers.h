@@ -26,16 +26,27 @@
 #define TIMER_ONE_SHOT (0)
 #define TIMER_INTERVAL (1)
 
+/*
+** Cdigos de error del reparto de temporizadores
+*/
+#define TIMER_OK       (0)
+#define TIMER_BUSY     (1)      /* El temporizador est reservado por otro dueo */
+#define TIMER_CONFLICT (2)      /* Su pareja (0-1, 2-3, 4-5) est reservada con otro preescalador */
+#define TIMER_INVALID  (3)      /* No existe el temporizador o el divisor */
+#define TIMER_NONE     (0xff)   /* Ningn temporizador disponible */
+
 /*
 ** Pone a 0 los registros de configuracin
 ** Pone a 0 todos los bfferes y registros de cuenta y comparacin
-** Para todos los temporizadores
+** Para todos los temporizadores y anula todas sus reservas
 ** Inicializa las variables para retardos software
+** Solo tiene efecto la primera llamada, que debe hacer la aplicacin antes de inicializar los drivers
 */
 void timers_init( void );
 
 /*
-** Realiza una espera de n milisegundos usando el timer3
+** Realiza una espera de n milisegundos usando un temporizador libre (por software si no hay ninguno)
+** Los retardos, medidas y plazos timer3_* reservan mientras los usan un temporizador libre a 10 kHz (N=199+1, D=32)
 */
 void timer3_delay_ms( uint16 n );
 
@@ -45,7 +56,7 @@ void timer3_delay_ms( uint16 n );
 void sw_delay_ms( uint16 n );
 
 /*
-** Realiza una espera de n segundos usando el timer3
+** Realiza una espera de n segundos usando un temporizador libre (por software si no hay ninguno)
 */
 void timer3_delay_s( uint16 n );
 
@@ -55,24 +66,26 @@ void timer3_delay_s( uint16 n );
 void sw_delay_s( uint16 n );
 
 /*
-** Arranca el timer3 a una frecuencia de 0,01 MHz 
+** Reserva un temporizador libre y lo arranca a una frecuencia de 0,01 MHz
 ** Permitir medir tiempos con una resolucin de 0,1 ms (100 us) hasta un mximo de 6.55s
 */
 void timer3_start( void );
 
 /*
-** Detiene el timer3, devolviendo el nmero de dcimas de milisegundo transcurridas desde que arranc hasta un mximo de 6.55s
+** Detiene y libera el temporizador de la medida, devolviendo el nmero de dcimas de milisegundo transcurridas desde
+** timer3_start hasta un mximo de 6.55s (0 si no haba ningn temporizador libre)
 */
 uint16 timer3_stop( void );
 
 /*
-** Arranca el timer3 a una frecuencia de 0,01 MHz
+** Reserva un temporizador libre y lo arranca a una frecuencia de 0,01 MHz
 ** Permitir contar n dcimas de milisegundo (0,1 ms = 100 us) hasta un mximo de 6.55s
 */
 void timer3_start_timeout( uint16 n );
 
 /*
-** Indica si el timer3 ha finalizado su cuenta
+** Indica si el plazo de timer3_start_timeout ha vencido, en cuyo caso libera su temporizador
+** Si no haba ningn temporizador libre el plazo vence enseguida
 */
 uint16 timer3_timeout( void );
 
@@ -81,23 +94,87 @@ uint16 timer3_timeout( void );
 ** Borra interrupciones pendientes del timer0
 ** Desenmascara globalmente las interrupciones y especficamente las interrupciones del timer0
 ** Configura el timer0 para que genere tps interrupciones por segundo
+** Devuelve el resultado de reservar el timer0 (TIMER_OK o el error, en cuyo caso no lo configura)
 */
-void timer0_open_tick( void (*isr)(void), uint16 tps );
+uint8 timer0_open_tick( void (*isr)(void), uint16 tps );
 
 /*
 ** Instala, en la tabla de vectores de interrupcin, la funcin isr como RTI de interrupciones del timer0
 ** Borra interrupciones pendientes del timer0
 ** Desenmascara globalmente las interrupciones y especficamente las interrupciones del timer0
 ** Configura el timer0 para que genere interrupciones en el modo y con la periodicidad indicadas
-** Configura el timer0 para que genere interrupciones en el modo y con la periodicidad indicadas
+** Devuelve el resultado de reservar el timer0 (TIMER_OK o el error, en cuyo caso no lo configura)
 */
-void timer0_open_ms( void (*isr)(void), uint16 ms, uint8 mode );
+uint8 timer0_open_ms( void (*isr)(void), uint16 ms, uint8 mode );
 
 /*
 ** Para y pone a 0 todos sus bufferes y registros del timer0
 ** Deshabilita las interrupciones del timer0
-** Desinstala la RTI del timer0
+** Desinstala la RTI del timer0 y lo libera
 */
 void timer0_close( void );
 
+/*
+** Instala la RTI del timer4 y lo configura como reloj montono de 1 us de resolucin que no se detiene nunca
+** Usa el preescalador de los timers 4 y 5 (N=3+1); el timer5 puede usarlo con el divisor 1/16 para contar a 1 MHz
+** Devuelve el resultado de reservar el timer4 (TIMER_OK o el error, en cuyo caso no lo configura)
+*/
+uint8 timer4_open_clock( void );
+
+/*
+** Devuelve los microsegundos transcurridos desde timer4_open_clock (se desborda cada 71,6 minutos)
+** Puede llamarse desde tareas y desde RTIs
+*/
+uint32 timer4_clock_us( void );
+
+/*
+** Devuelve los microsegundos transcurridos desde timer4_open_clock con 64 bits (no se desborda en la prctica)
+*/
+uint64 timer4_clock_us64( void );
+
+/*
+** Reserva el temporizador n (0-5) para owner con preescalador N=prescaler+1 y divisor D=2^(mux+1) (mux 0-4; en los timers 4 y 5, 4 selecciona TCLK y devuelve TIMER_INVALID)
+** El preescalador es comn a cada pareja (0-1, 2-3, 4-5): si la otra mitad est reservada con otro distinto devuelve TIMER_CONFLICT
+** Si ya lo tiene el mismo owner solo cambia su configuracin; si lo tiene otro devuelve TIMER_BUSY
+** Si devuelve TIMER_OK deja programados TCFG0 y TCFG1; en otro caso no toca nada
+*/
+uint8 timer_alloc( uint8 n, uint8 prescaler, uint8 mux, const char *owner );
+
+/*
+** Reserva para owner el primer temporizador libre compatible con el preescalador y devuelve su nmero (TIMER_NONE si no hay)
+** Prefiere los que comparten pareja con uno ya reservado con el mismo preescalador, para no bloquear parejas libres
+*/
+uint8 timer_alloc_any( uint8 prescaler, uint8 mux, const char *owner );
+
+/*
+** Para el temporizador n, enmascara y desinstala su RTI y lo libera
+*/
+void timer_free( uint8 n );
+
+/*
+** Devuelve el dueo del temporizador n (NULL si est libre)
+*/
+const char *timer_owner( uint8 n );
+
+/*
+** Configura el temporizador n (que debe estar reservado) para contar count ciclos en el modo indicado, sin arrancarlo
+** Si isr no es NULL la instala como RTI, borra su interrupcin pendiente y la desenmascara (la RTI debe borrarla en I_ISPC)
+*/
+void timer_open( uint8 n, void (*isr)(void), uint16 count, uint8 mode );
+
+/*
+** Arranca el temporizador n desde el valor cargado con timer_open
+*/
+void timer_start( uint8 n );
+
+/*
+** Para el temporizador n
+*/
+void timer_stop( uint8 n );
+
+/*
+** Devuelve la cuenta actual del temporizador n
+*/
+uint16 timer_read( uint8 n );
+
 #endif 
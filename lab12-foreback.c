@@ -25,23 +25,25 @@
 #include <pbs.h>
 #include <keypad.h>
 #include <timers.h>
+#include <swtimers.h>
 #include <rtc.h>
 #include <lcd.h>
 
-#define TICKS_PER_SEC   (100)
-
 /* Declaracin de recursos */
 
-uint8 scancode;
-boolean flagTask5;
-boolean flagTask6;
+volatile uint8 scancode;
+volatile boolean flagTask5;
+volatile boolean flagTask6;
 
 volatile boolean flagPb;
 volatile boolean flagToggleLeds;
-volatile boolean flagReadKeypad;
 volatile boolean flagWriteRTC;
 volatile boolean flagWriteTicks;
 
+swtimer_t timerToggleLeds;
+swtimer_t timerWriteRTC;
+swtimer_t timerWriteTicks;
+
 /* Declaracin de tareas */
 
 void Task1( void );
@@ -57,7 +59,11 @@ void Task9(void);
 /* Declaracin de RTI */
 
 void isr_pb( void ) __attribute__ ((interrupt ("IRQ")));
-void isr_tick( void ) __attribute__ ((interrupt ("IRQ")));
+
+/* Declaracin de funciones de vencimiento (se ejecutan en la RTI del timer5) */
+
+void set_flag( void *flag );
+void keypad_ready( uint8 key );
 
 /*******************************************************************/
 
@@ -82,7 +88,6 @@ void main( void )
     flagTask6      = FALSE;
     flagPb         = FALSE;
     flagToggleLeds = FALSE;
-    flagReadKeypad = FALSE;
     flagWriteRTC   = FALSE;
     flagWriteTicks = FALSE;
 
@@ -97,7 +102,15 @@ void main( void )
     Task9();
    
     pbs_open( isr_pb );                           /* Instala isr_pbs como RTI por presin de pulsadores  */
-    timer0_open_tick( isr_tick, TICKS_PER_SEC );  /* Instala isr_tick como RTI del timer0  */
+    timer4_open_clock();                          /* Reloj con el que se mide el tiempo en modo sin tick */
+    swtimers_init();                              /* Reserva el timer5 para los temporizadores software... */
+    swtimers_tickless( TRUE );                    /* ... que solo interrumpe cuando vence alguno */
+    swtimer_init( &timerToggleLeds, set_flag, (void *) &flagToggleLeds );
+    swtimer_init( &timerWriteRTC, set_flag, (void *) &flagWriteRTC );
+    swtimer_init( &timerWriteTicks, set_flag, (void *) &flagWriteTicks );
+    swtimer_start( &timerToggleLeds, 500, TIMER_INTERVAL );
+    swtimer_start( &timerWriteRTC, 1000, TIMER_INTERVAL );
+    swtimer_start( &timerWriteTicks, 10000, TIMER_INTERVAL );
         
     while( 1 )
     {
@@ -107,11 +120,6 @@ void main( void )
             flagToggleLeds = FALSE;
             Task1();
         }
-        if( flagReadKeypad )        
-        {
-            flagReadKeypad = FALSE;
-            Task2();
-        }
         if( flagWriteRTC )
         {
             flagWriteRTC = FALSE;
@@ -139,12 +147,13 @@ void main( void )
             flagPb = FALSE;
             Task7();
         }
+        lcd_dl_render();                /* Pinta en una sola pasada lo que han dibujado las tareas */
     }
 }
 
 /*******************************************************************/
 
-void Task1( void )  /* Cada 0,5 segundos (50 ticks) alterna el led que se enciende */
+void Task1( void )  /* Cada 0,5 segundos alterna el led que se enciende */
 {
     static boolean init = TRUE;
   
@@ -162,40 +171,19 @@ void Task1( void )  /* Cada 0,5 segundos (50 ticks) alterna el led que se encien
     }
 }
 
-void Task2( void )  /* Cada 50 ms (5 ticks) muestrea el keypad y enva el scancode a otras tareas */
+void Task2( void )  /* Pide al driver la lectura no bloqueante del keypad; keypad_ready enva el scancode a otras tareas */
 {
     static boolean init = TRUE;
-    static enum { wait_keydown, scan, wait_keyup } state;
 
     if( init )
     {
-        init  = FALSE;
+        init = FALSE;
         uart0_puts( " Task 2: iniciada.\n" );  /* Muestra un mensaje inicial en la UART0 (no es necesario semforo) */
-        state = wait_keydown;
-    }
-    else switch( state )
-    {
-        case wait_keydown:
-            if( keypad_pressed() )
-                state = scan;
-            break;
-        case scan:
-            scancode = keypad_scan();
-            if( scancode != KEYPAD_FAILURE )
-            {
-                flagTask5 = TRUE;
-                flagTask6 = TRUE;
-            }
-            state = wait_keyup;
-            break;
-        case wait_keyup:
-            if( !keypad_pressed() )
-                state = wait_keydown;
-            break;
+        keypad_getchar_async( keypad_ready );
     }
 }
 
-void Task3( void  )  /* Cada segundo (100 ticks) muestra por la UART0 la hora del RTC */
+void Task3( void  )  /* Cada segundo muestra por la UART0 la hora del RTC */
 {
     static boolean init = TRUE;
     rtc_time_t rtc_time;
@@ -218,22 +206,19 @@ void Task3( void  )  /* Cada segundo (100 ticks) muestra por la UART0 la hora de
     }
 }
 
-void Task4( void )  /* Cada 10 segundos (1000 ticks) muestra por la UART0 los ticks transcurridos */
+void Task4( void )  /* Cada 10 segundos muestra por la UART0 los ticks (ms) transcurridos */
 {
     static boolean init = TRUE;
-    static uint32 ticks;
     
     if( init )
     {
         init = FALSE;
         uart0_puts( " Task 4: iniciada.\n" );  /* Muestra un mensaje inicial en la UART0 (no es necesario semforo) */
-        ticks = 0;
     }
     else
     {
-        ticks += TICKS_PER_SEC * 10;
         uart0_puts( "  (Task 4) Ticks: " );
-        uart0_putint( ticks );
+        uart0_putint( swtimers_ticks() );
         uart0_puts( "\n" );
     }
 }
@@ -290,9 +275,9 @@ void Task8(void){
 	    if( init )
 	    {
 	        init = FALSE;
-	        lcd_draw_box( 10, 10, 310, 230, BLACK, 5 );
+	        lcd_dl_draw_box( 10, 10, 310, 230, BLACK, 5 );
 	        uart0_puts( " Task 8: iniciada.\n" );  /* Muestra un mensaje inicial en la UART0 (no es necesario semforo) */
-	        lcd_puts( 20,32,BLACK," Task 8: iniciada.\n");
+	        lcd_dl_puts( 20,32,BLACK," Task 8: iniciada.\n");
 	    }
 
 	    else
@@ -300,22 +285,24 @@ void Task8(void){
 
 			//lcd_clear();
 			//lcd_draw_hline(0,LCD_WIDTH-1,32,0,16);
-			lcd_draw_box( 10, 10, 310, 230, BLACK, 5 );
-			lcd_puts( 20,32,BLACK,"  (Task 8) Tecla pulsada: " );
+			lcd_dl_draw_box( 10, 10, 310, 230, BLACK, 5 );
+			lcd_dl_puts( 20,32,BLACK,"  (Task 8) Tecla pulsada: " );
 			//uart0_puthex( scancode );
-			lcd_puthex(27*8,32,BLACK,scancode);
+			lcd_dl_puthex(27*8,32,BLACK,scancode);
 			//uart0_puts( "\n" );
 		}
 }
 void Task9(void){
+	static lcd_field_t hour = LCD_FIELD( 20+16*8, 16, BLACK, 2, '0', 1 );
+	static lcd_field_t min = LCD_FIELD( 20+19*8, 16, BLACK, 2, '0', 1 );
+	static lcd_field_t sec = LCD_FIELD( 20+22*8, 16, BLACK, 2, '0', 1 );
 	static boolean init = TRUE;
 	rtc_time_t rtc_time;
-	uint8 pos = 20;
 	if( init )
 	{
 		init = FALSE;
 
-		lcd_draw_box( 10, 10, 310, 230, BLACK, 5 );
+		lcd_dl_draw_box( 10, 10, 310, 230, BLACK, 5 );
 		uart0_puts( " Task 9: iniciada.\n" );/* Muestra un mensaje inicial en la UART0 (no es necesario semforo) */
 		lcd_puts(20,16,BLACK," Task 9: iniciada.\n");
 	}
@@ -331,23 +318,16 @@ void Task9(void){
 		//uart0_puts( "\n" );
 		//lcd_clear();
 		//lcd_draw_hline(0,LCD_WIDTH-1,16,0,16);
-		lcd_draw_box( 10, 10, 310, 230, BLACK, 5 );
-		lcd_puts(pos,16,BLACK,"  (Task 9) Hora: " );
-		pos = pos + 16*8;
-		lcd_putint(pos,16,BLACK,rtc_time.hour);
-		if(rtc_time.hour>9)pos = pos +1*8;
-		pos = pos +1*8;
-		lcd_puts(pos,16,BLACK,":");
-		pos = pos +1*8;
-		lcd_putint(pos,16,BLACK,rtc_time.min);
-		if(rtc_time.min>9)pos = pos +1*8;
-		pos = pos + 1*8;
-		lcd_puts(pos,16,BLACK,":");
-		pos = pos+1*8;
-		lcd_putint(pos,16,BLACK,rtc_time.sec);
-		if(rtc_time.sec>9)pos = pos +1*8;
-		pos = pos +1*8;
-		lcd_puts(pos,16,BLACK,"   ");
+		lcd_dl_draw_box( 10, 10, 310, 230, BLACK, 5 );
+		if( !sec.shown[0] )                 /* Rtulo fijo: solo se pinta junto con el campo de segundos */
+		{
+			lcd_puts( 20, 16, BLACK, "  (Task 9) Hora: " );
+			lcd_puts( 20+18*8, 16, BLACK, ":" );
+			lcd_puts( 20+21*8, 16, BLACK, ":" );
+		}
+		lcd_field_putint( &hour, rtc_time.hour );    /* Solo se redibujan las cifras que cambian */
+		lcd_field_putint( &min, rtc_time.min );
+		lcd_field_putint( &sec, rtc_time.sec );
 		//lcd_puts()
 
 	}
@@ -361,35 +341,20 @@ void isr_pb( void )
     I_ISPC = BIT_PB;
 }
 
-void isr_tick( void )
-{  
-    static uint16 cont5ticks    = 5;
-    static uint16 cont50ticks   = 50;
-    static uint16 cont100ticks  = 100;
-    static uint16 cont1000ticks = 1000;
-    
-    if( !(--cont5ticks) )
+void set_flag( void *flag )
+{
+    *(volatile boolean *) flag = TRUE;
+}
+
+void keypad_ready( uint8 key )
+{
+    if( key != KEYPAD_FAILURE )
     {
-        cont5ticks = 5;
-        flagReadKeypad = TRUE;  
+        scancode  = key;
+        flagTask5 = TRUE;
+        flagTask6 = TRUE;
     }
-    if( !(--cont50ticks) )
-    {
-        cont50ticks = 50;
-        flagToggleLeds = TRUE;
-    }        
-    if( !(--cont100ticks) )
-    {
-        cont100ticks = 100;
-        flagWriteRTC  = TRUE;
-    }    
-    if( !(--cont1000ticks) )
-    {
-        cont1000ticks = 1000;
-        flagWriteTicks = TRUE;
-    }   
-    
-    I_ISPC = BIT_TIMER0;
-};
+    keypad_getchar_async( keypad_ready );    /* Pide la siguiente tecla */
+}
 
 /*******************************************************************/
@@ -99,6 +99,7 @@ void main( void )
     {
         sleep();                /* Entra en estado IDLE, sale por interrupcin */
         dispacher();            /* Las tareas preparadas se ejecutan en esta hebra (background) en orden de prioridad */
+        lcd_dl_render();        /* Pinta en una sola pasada lo que han dibujado las tareas */
     }
 
 }
@@ -255,9 +256,9 @@ void Task8(void){
 	if( init )
 	{
 		init = FALSE;
-		lcd_draw_box( 10, 10, 310, 230, BLACK, 5 );
+		lcd_dl_draw_box( 10, 10, 310, 230, BLACK, 5 );
 		uart0_puts( " Task 8: iniciada.\n" );  /* Muestra un mensaje inicial en la UART0 (no es necesario semforo) */
-		lcd_puts( 20,32,BLACK," Task 8: iniciada.\n");
+		lcd_dl_puts( 20,32,BLACK," Task 8: iniciada.\n");
 	}
 
 	else if(flagTask8)
@@ -265,22 +266,24 @@ void Task8(void){
 
 		//lcd_clear();
 		//lcd_draw_hline(0,LCD_WIDTH-1,32,0,16);
-		lcd_draw_box( 10, 10, 310, 230, BLACK, 5 );
-		lcd_puts( 20,32,BLACK,"  (Task 8) Tecla pulsada: " );
+		lcd_dl_draw_box( 10, 10, 310, 230, BLACK, 5 );
+		lcd_dl_puts( 20,32,BLACK,"  (Task 8) Tecla pulsada: " );
 		//uart0_puthex( scancode );
-		lcd_puthex(27*8,32,BLACK,scancode);
+		lcd_dl_puthex(27*8,32,BLACK,scancode);
 		//uart0_puts( "\n" );
 	}
 }
 void Task9(void){
+	static lcd_field_t hour = LCD_FIELD( 20+16*8, 16, BLACK, 2, '0', 1 );
+	static lcd_field_t min = LCD_FIELD( 20+19*8, 16, BLACK, 2, '0', 1 );
+	static lcd_field_t sec = LCD_FIELD( 20+22*8, 16, BLACK, 2, '0', 1 );
 	static boolean init = TRUE;
 	rtc_time_t rtc_time;
-	uint8 pos = 20;
 	if( init )
 	{
 		init = FALSE;
 
-		lcd_draw_box( 10, 10, 310, 230, BLACK, 5 );
+		lcd_dl_draw_box( 10, 10, 310, 230, BLACK, 5 );
 		uart0_puts( " Task 9: iniciada.\n" );/* Muestra un mensaje inicial en la UART0 (no es necesario semforo) */
 		lcd_puts(20,16,BLACK," Task 9: iniciada.\n");
 	}
@@ -296,23 +299,16 @@ void Task9(void){
 		//uart0_puts( "\n" );
 		//lcd_clear();
 		//lcd_draw_hline(0,LCD_WIDTH-1,16,0,16);
-		lcd_draw_box( 10, 10, 310, 230, BLACK, 5 );
-		lcd_puts(pos,16,BLACK,"  (Task 9) Hora: " );
-		pos = pos + 16*8;
-		lcd_putint(pos,16,BLACK,rtc_time.hour);
-		if(rtc_time.hour>9)pos = pos +1*8;
-		pos = pos +1*8;
-		lcd_puts(pos,16,BLACK,":");
-		pos = pos +1*8;
-		lcd_putint(pos,16,BLACK,rtc_time.min);
-		if(rtc_time.min>9)pos = pos +1*8;
-		pos = pos + 1*8;
-		lcd_puts(pos,16,BLACK,":");
-		pos = pos+1*8;
-		lcd_putint(pos,16,BLACK,rtc_time.sec);
-		if(rtc_time.sec>9)pos = pos +1*8;
-		pos = pos +1*8;
-		lcd_puts(pos,16,BLACK,"   ");
+		lcd_dl_draw_box( 10, 10, 310, 230, BLACK, 5 );
+		if( !sec.shown[0] )                 /* Rtulo fijo: solo se pinta junto con el campo de segundos */
+		{
+			lcd_puts( 20, 16, BLACK, "  (Task 9) Hora: " );
+			lcd_puts( 20+18*8, 16, BLACK, ":" );
+			lcd_puts( 20+21*8, 16, BLACK, ":" );
+		}
+		lcd_field_putint( &hour, rtc_time.hour );    /* Solo se redibujan las cifras que cambian */
+		lcd_field_putint( &min, rtc_time.min );
+		lcd_field_putint( &sec, rtc_time.sec );
 		//lcd_puts()
 
 	}
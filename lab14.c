@@ -317,6 +317,9 @@ void Task8(void* id){
 	}
 }
 void Task9(void*id ){
+	static lcd_field_t hour = LCD_FIELD( 20+16*8, 16, BLACK, 2, '0', 1 );
+	static lcd_field_t min = LCD_FIELD( 20+19*8, 16, BLACK, 2, '0', 1 );
+	static lcd_field_t sec = LCD_FIELD( 20+22*8, 16, BLACK, 2, '0', 1 );
 	INT8U err;
 	rtc_time_t rtc_time;
 
@@ -332,25 +335,17 @@ void Task9(void*id ){
 		OSTimeDly( 100 );
 			rtc_gettime( &rtc_time );
 			OSSemPend( uart0Sem, 0, &err );
-		uint8 pos = 20;
 		rtc_gettime( &rtc_time );
 		lcd_draw_box( 10, 10, 310, 230, BLACK, 5 );
-		lcd_puts(pos,16,BLACK,"  (Task 9) Hora: " );
-		pos = pos + 16*8;
-		lcd_putint(pos,16,BLACK,rtc_time.hour);
-		if(rtc_time.hour>9)pos = pos +1*8;
-		pos = pos +1*8;
-		lcd_puts(pos,16,BLACK,":");
-		pos = pos +1*8;
-		lcd_putint(pos,16,BLACK,rtc_time.min);
-		if(rtc_time.min>9)pos = pos +1*8;
-		pos = pos + 1*8;
-		lcd_puts(pos,16,BLACK,":");
-		pos = pos+1*8;
-		lcd_putint(pos,16,BLACK,rtc_time.sec);
-		if(rtc_time.sec>9)pos = pos +1*8;
-		pos = pos +1*8;
-		lcd_puts(pos,16,BLACK,"   ");
+		if( !sec.shown[0] )                 /* Rtulo fijo: solo se pinta junto con el campo de segundos */
+		{
+			lcd_puts( 20, 16, BLACK, "  (Task 9) Hora: " );
+			lcd_puts( 20+18*8, 16, BLACK, ":" );
+			lcd_puts( 20+21*8, 16, BLACK, ":" );
+		}
+		lcd_field_putint( &hour, rtc_time.hour );    /* Solo se redibujan las cifras que cambian */
+		lcd_field_putint( &min, rtc_time.min );
+		lcd_field_putint( &sec, rtc_time.sec );
 		//lcd_puts()
 		OSSemPost( uart0Sem );
 	}
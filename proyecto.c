@@ -3,89 +3,101 @@
 #include <common_types.h>
 #include <system.h>
 #include <timers.h>
+#include <swtimers.h>
 #include <lcd.h>
 #include <pbs.h>
 #include <keypad.h>
 
-#define TICKS_PER_SEC (100)
+#define DUMMY_MS (500)     // Periodo inicial de movimiento del dummy
 
-/* Declaracin de graficos */
+/* Declaracin de graficos (bitmaps nativos cargados con load_spr.txt) */
 
 #define LANDSCAPE  ((uint8 *)0x0c250000)
 #define FIREMEN    ((uint8 *)0x0c260000)
 #define CRASH      ((uint8 *)0x0c260800)
-#define DUMMY_0    ((uint8 *)0x0c270000)
-#define DUMMY_90   ((uint8 *)0x0c270400)
-#define DUMMY_180  ((uint8 *)0x0c270800)
-#define DUMMY_270  ((uint8 *)0x0c270C00)
+#define DUMMY      ((uint8 *)0x0c270000)    // Las 4 formas del dummy se obtienen girndolo al pintarlo
 #define LIFE       ((uint8 *)0x0c271000)
 
+lcd_bitmap_t *landscapeBmp;     // Bitmaps validados por graphics_load (NULL hasta entonces)
+lcd_bitmap_t *firemenBmp;
+lcd_bitmap_t *crashBmp;
+lcd_bitmap_t *dummyBmp;
+lcd_bitmap_t *lifeBmp;
+
 typedef struct plots {
     uint16 x;               // Posicin x en donde se pinta el grfico
     uint16 y;               // Posicin y en donde se pinta el grfico
-    uint8 *plot;            // Puntero al BMP que contiene el grfico
+    lcd_bitmap_t **plot;    // Puntero al puntero del bitmap que contiene el grfico (lo fija graphics_load)
+    uint8 orient;           // Orientacin con la que se pinta el bitmap (LCD_ROT_*)
 } plots_t;
 
 typedef struct sprite {
     uint16 width;           // Anchura del grfico en pixeles
     uint16 height;          // Altura del grfico en pixeles
     uint16 num_plots;       // Nmero de posiciones diferentes en donde pintar el grfico
+    uint8 z;                // Profundidad a la que se compone el grfico (mayor z, ms arriba)
+    uint8 *layers;          // Sprites del driver asignados a cada posicin (LCD_SPRITE_NONE si an no se ha pintado)
     plots_t plots[];        // Array de posiciones en donde pintar el grfico
 } sprite_t;
 
+uint8 firemen_layers[3];
+uint8 dummy_layers[19];
+uint8 crash_layers[3];
+uint8 life_layers[3];
+
 const sprite_t firemen = 
 {
-    64, 32, 3,                      // Los bomberos de tamao 64x32 se pintan en 3 posiciones distintas
+    64, 32, 3, 1, firemen_layers,   // Los bomberos de tamao 64x32 se pintan en 3 posiciones distintas
     {
-        {  32, 176, FIREMEN },
-        { 128, 176, FIREMEN },
-        { 224, 176, FIREMEN }
+        {  32, 176, &firemenBmp, LCD_ROT_0 },
+        { 128, 176, &firemenBmp, LCD_ROT_0 },
+        { 224, 176, &firemenBmp, LCD_ROT_0 }
     }
 };
 
 const sprite_t dummy = 
 {
-    32, 32, 19,                    // Los dummies de tamao 32x32 se pintan en 19 posiciones distintas con 4 formas diferentes que se alternan
+    32, 32, 19, 2, dummy_layers,   // Los dummies de tamao 32x32 se pintan en 19 posiciones distintas con 4 formas diferentes que se alternan
     {
-        {   0,  64, DUMMY_0   },
-        {  16,  96, DUMMY_90  },
-        {  32, 128, DUMMY_180 },
-        {  48, 160, DUMMY_270 },
-        {  64, 128, DUMMY_0   },
-        {  80,  96, DUMMY_90  },
-        {  96,  64, DUMMY_180 },
-        { 112,  96, DUMMY_270 },
-        { 128, 128, DUMMY_0   },
-        { 144, 160, DUMMY_90  },
-        { 160, 128, DUMMY_180 },
-        { 176,  96, DUMMY_270 },
-        { 192,  64, DUMMY_0   },
-        { 208,  96, DUMMY_90  },
-        { 224, 128, DUMMY_180 },
-        { 240, 160, DUMMY_270 },
-        { 256, 128, DUMMY_0   },
-        { 272, 96,  DUMMY_90  },
-        { 288, 64,  DUMMY_180 }
+        {   0,  64, &dummyBmp, LCD_ROT_0   },
+        {  16,  96, &dummyBmp, LCD_ROT_90  },
+        {  32, 128, &dummyBmp, LCD_ROT_180 },
+        {  48, 160, &dummyBmp, LCD_ROT_270 },
+        {  64, 128, &dummyBmp, LCD_ROT_0   },
+        {  80,  96, &dummyBmp, LCD_ROT_90  },
+        {  96,  64, &dummyBmp, LCD_ROT_180 },
+        { 112,  96, &dummyBmp, LCD_ROT_270 },
+        { 128, 128, &dummyBmp, LCD_ROT_0   },
+        { 144, 160, &dummyBmp, LCD_ROT_90  },
+        { 160, 128, &dummyBmp, LCD_ROT_180 },
+        { 176,  96, &dummyBmp, LCD_ROT_270 },
+        { 192,  64, &dummyBmp, LCD_ROT_0   },
+        { 208,  96, &dummyBmp, LCD_ROT_90  },
+        { 224, 128, &dummyBmp, LCD_ROT_180 },
+        { 240, 160, &dummyBmp, LCD_ROT_270 },
+        { 256, 128, &dummyBmp, LCD_ROT_0   },
+        { 272, 96,  &dummyBmp, LCD_ROT_90  },
+        { 288, 64,  &dummyBmp, LCD_ROT_180 }
     }
 };
 
 const sprite_t crash = 
 {
-    64, 32, 3,                     // Los dummies estrellados de tamao 64x32 se pintan en 3 posiciones distintas
+    64, 32, 3, 0, crash_layers,    // Los dummies estrellados de tamao 64x32 se pintan en 3 posiciones distintas
     {
-        {   32, 208, CRASH },
-        {  128, 208, CRASH },
-        {  224, 208, CRASH }
+        {   32, 208, &crashBmp, LCD_ROT_0 },
+        {  128, 208, &crashBmp, LCD_ROT_0 },
+        {  224, 208, &crashBmp, LCD_ROT_0 }
     }
 };
 
 const sprite_t life =
 {
-    16, 16, 3,                    // Los corazones estrellados de tamao 16x16 se pintan en 3 posiciones distintas
+    16, 16, 3, 0, life_layers,    // Los corazones estrellados de tamao 16x16 se pintan en 3 posiciones distintas
     {
-        {   8, 8, LIFE },
-        {  24, 8, LIFE },
-        {  40, 8, LIFE }
+        {   8, 8, &lifeBmp, LCD_ROT_0 },
+        {  24, 8, &lifeBmp, LCD_ROT_0 },
+        {  40, 8, &lifeBmp, LCD_ROT_0 }
     }
 };
 
@@ -112,11 +124,14 @@ boolean fifo_is_full( void );
 
 volatile fifo_t fifo;       // Cola de tareas
 boolean gameOver;           // Flag de sealizacin del fin del juego
+swtimer_t pollTimer;        // Temporizador de muestreo de teclado y pulsadores
+swtimer_t dummyTimer;       // Temporizador de movimiento del dummy
 
 /* Declaracin de variables */
 
 uint8 dummyPos;     // Posicin del dummy 
 uint16 count;       // Nmero de dummies salvados
+lcd_field_t countField;     // Campo en el que se muestra count (solo se redibujan las cifras que cambian)
 uint8 firemenPos;	// Posicion del firemen
 uint8 countLife;	// Contador de vidas
 uint8 mode;			// Modo de juego
@@ -131,6 +146,8 @@ void firemen_init(void); 									// Inicializa la posicion del firemen y lo dib
 void mode_init( void );										// Inicializa el modo de juego
 void sprite_plot( sprite_t const *sprite, uint16 pos );     // Dibuja el grfico en la posicin indicada
 void sprite_clear( sprite_t const *sprite, uint16 pos );    // Borra el grfico pintado en la posicin indicada
+void sprites_init( void );                                  // Elimina todos los grficos y dibuja el fondo
+boolean graphics_load( void );                              // Valida los bitmaps cargados en memoria
 
 /* Declaracin de tareas */
 
@@ -140,9 +157,12 @@ void count_inc( void );     // Incrementa el contador de dummies salvados
 void mode_change( void );	// Cambia el modo del juego
 void new_mode( void );		// Establece el nuevo modo de juego y su configuracion
 void firemen_move(void);	// Mueve el firemen
-/* Declaracin de RTI */
+uint16 dummy_period( void );    // Devuelve el periodo de movimiento del dummy segn el modo
 
-void isr_tick( void ) __attribute__ ((interrupt ("IRQ")));
+/* Declaracin de funciones de vencimiento (se ejecutan en la RTI del timer5) */
+
+void poll_tick( void *arg );
+void dummy_tick( void *arg );
 
 /*******************************************************************/
 
@@ -157,10 +177,17 @@ void main( void )
     pbs_init();
     
     lcd_on();
+    lcd_buffering( LCD_DOUBLE_COPY );           // Se dibuja en el buffer oculto y se muestra con lcd_flip
     lcd_clear();
+    if( !graphics_load() )                      // Sin los grficos no se puede jugar
+    {
+        lcd_puts_x2( 16, 112, BLACK, "FALTAN GRAFICOS" );
+        lcd_flip();
+        while( 1 );
+    }
 	mode_init();								// Inicializa el modo
 
-	lcd_putWallpaper( LANDSCAPE );              // Dibuja el fondo de la pantalla
+	sprites_init();                             // Dibuja el fondo de la pantalla
 
 	for( i=0; i<life.num_plots; i++ )           // Dibuja los corazones en todas sus posiciones posibles
 		sprite_plot( &life, i );
@@ -171,18 +198,34 @@ void main( void )
 	dummy_init();                               // Inicializa las tareas
 	count_init();
 	firemen_init();
+	lcd_sprites_render();
+	lcd_flip();
 
 
 	fifo_init();                                  // Inicializa cola de funciones
-    timer0_open_tick( isr_tick, TICKS_PER_SEC );  // Instala isr_tick como RTI del timer0
+    timer4_open_clock();                          // Reloj con el que se mide el tiempo en modo sin tick
+    swtimers_init();                              // Temporizadores software sobre el timer5...
+    swtimers_tickless( TRUE );                    // ... que solo interrumpe cuando vence alguno
+    swtimer_init( &pollTimer, poll_tick, NULL );
+    swtimer_init( &dummyTimer, dummy_tick, NULL );
+    swtimer_start( &pollTimer, 50, TIMER_INTERVAL );
+    swtimer_start( &dummyTimer, dummy_period(), TIMER_ONE_SHOT );
            
     while( !gameOver )
     {
-//      sleep();                        // Entra en estado IDLE, sale por interrupcin
-        while( !fifo_is_empty() )
+        INT_DISABLE;                    // Una RTI que encole entre la comprobacin y el paso a IDLE no debe quedar esperando
+        if( fifo_is_empty() )
+            sleep();                    // Entra en estado IDLE solo si no queda nada pendiente, sale por interrupcin
+        INT_ENABLE;                     // La interrupcin que despert a la CPU se atiende aqu
+        if( !fifo_is_empty() )
         {
-            pf = fifo_dequeue();
-            (*pf)();                    // Las tareas encoladas se ejecutan en esta hebra (background) en orden de encolado
+            while( !fifo_is_empty() )
+            {
+                pf = fifo_dequeue();
+                (*pf)();                // Las tareas encoladas se ejecutan en esta hebra (background) en orden de encolado,
+            }                           // incluidas las que encolen las RTIs mientras se vaca la cola
+            lcd_sprites_render();       // Recompone solo las zonas en las que han cambiado los grficos
+            lcd_flip();                 // Muestra el frame completo de una sola vez
         }
         if(gameOver){
         	lcd_clear();
@@ -191,8 +234,10 @@ void main( void )
         }
     }
     lcd_puts_x2(88,120,BLACK,"GAME OVER ");
+    lcd_flip();
     
-    timer0_close();
+    swtimer_stop( &pollTimer );
+    swtimer_stop( &dummyTimer );
     while(1);
 }
 
@@ -280,6 +325,7 @@ void mode_init( void ){
 	lcd_puts_x2(10,70,BLACK, "Mode 2: Advanced ");
 	lcd_puts_x2(10,100,BLACK, "Mode 3: Infinity ");
 	lcd_puts_x2(10,130,BLACK, "EXIT");
+	lcd_flip();
 	uint8 scancode;
 	while((scancode= keypad_scan())==KEYPAD_FAILURE);
 	gameOver = FALSE;
@@ -303,7 +349,7 @@ void mode_init( void ){
 
 void new_mode( void ){
     lcd_clear();
-    lcd_putWallpaper( LANDSCAPE );              // Dibuja el fondo de la pantalla
+    sprites_init();                             // Dibuja el fondo de la pantalla
 
     uint8 i;
     for( i=0; i<life.num_plots; i++ )           // Dibuja los corazones en todas sus posiciones posibles
@@ -365,107 +411,82 @@ void mode_change( void ){
 void count_init( void )
 {
     count = 0;                              // Inicializa el contador de dummies salvados...
-    lcd_putint_x2( 287, 0, BLACK, count );  // ... y lo dibuja
+    lcd_field_init( &countField, 271, 0, BLACK, 2, ' ', 2 );
+    lcd_field_putint( &countField, count ); // ... y lo dibuja
 }
 
 void count_inc( void )
 {
     count++;                                // Incrementa el contador de dummies salvados
-    lcd_putint_x2( 287, 0, BLACK, count );
+    lcd_field_putint( &countField, count );
     if( count == 9 && mode != 3)            // Si se han salvado 9 dummies...
         gameOver = TRUE;                    // ... sealiza fin del juego
 }
 
 /*******************************************************************/
 
-void isr_tick( void )
-{   
-	static uint16 cont50ticks = 50;
-	static uint16 cont5ticks = 5;
-	if(!pause){
-		if(!(--cont5ticks))
-		{
-			cont5ticks = 5;
-			fifo_enqueue(mode_change);
-			fifo_enqueue(firemen_move);
-		}
-		if(mode == 1){
-			if( !(--cont50ticks) )
-			{
-				cont50ticks = 50;
-				fifo_enqueue( dummy_move );
-			}
-		}
-		else {
-			if( (--cont50ticks)-(2*count) <=0 )
-			{
-				cont50ticks = 50;
-				fifo_enqueue( dummy_move );
-			}
-		}
-	}
-	else{
-		if(!(--cont5ticks))
-		{
-			cont5ticks = 5;
-			fifo_enqueue(mode_change);
-		}
-	}
-    I_ISPC = BIT_TIMER0;
-};
+void poll_tick( void *arg )                 // Cada 50 ms muestrea el teclado y, si no hay pausa, los pulsadores
+{
+    fifo_enqueue( mode_change );
+    if( !pause )
+        fifo_enqueue( firemen_move );
+}
 
-/*******************************************************************/
+void dummy_tick( void *arg )                // Mueve el dummy si no hay pausa y vuelve a programarse
+{
+    if( !pause )
+        fifo_enqueue( dummy_move );
+    swtimer_start( &dummyTimer, dummy_period(), TIMER_ONE_SHOT );
+}
 
-extern uint8 lcd_buffer[];
+uint16 dummy_period( void )                 // En los modos 2 y 3 el dummy se acelera 20 ms por cada dummy salvado
+{
+    if( mode == 1 )
+        return DUMMY_MS;
+    return (20*count < DUMMY_MS - 10) ? DUMMY_MS - 20*count : 10;
+}
 
-void lcd_putBmp( uint8 *bmp, uint16 x, uint16 y, uint16 xsize, uint16 ysize );
-void lcd_clearWindow( uint16 x, uint16 y, uint16 xsize, uint16 ysize );
+/*******************************************************************/
 
 void sprite_plot( sprite_t const *sprite, uint16 num )
 {
-    lcd_putBmp( sprite->plots[num].plot, sprite->plots[num].x, sprite->plots[num].y, sprite->width, sprite->height );
+    if( sprite->layers[num] == LCD_SPRITE_NONE )
+    {
+        sprite->layers[num] = lcd_sprite_add( *sprite->plots[num].plot, sprite->plots[num].x, sprite->plots[num].y, sprite->z, WHITE );
+        lcd_sprite_orient( sprite->layers[num], sprite->plots[num].orient );
+    }
+    else
+        lcd_sprite_show( sprite->layers[num], TRUE );
 }
 
 void sprite_clear( sprite_t const *sprite, uint16 num )
 {
-    lcd_clearWindow( sprite->plots[num].x, sprite->plots[num].y, sprite->width, sprite->height );
+    if( sprite->layers[num] != LCD_SPRITE_NONE )
+        lcd_sprite_show( sprite->layers[num], FALSE );
 }
 
-/*
-** Muestra un BMP de tamao (xsize, ysize) pxeles en la posicin (x,y)
-** Esta funcin es una generalizacin de lcd_putWallpaper
-*/
-void lcd_putBmp( uint8 *bmp, uint16 x, uint16 y, uint16 xsize, uint16 ysize )
+void sprites_init( void )
 {
-	uint32 headerSize;
-
-	uint16 xSrc, ySrc, yDst;
-	uint16 offsetSrc, offsetDst;
+    uint16 i;
 
-	headerSize = bmp[10] + (bmp[11] << 8) + (bmp[12] << 16) + (bmp[13] << 24);
-
-	bmp = bmp + headerSize; 
-
-	for( ySrc=0, yDst=ysize-1; ySrc<ysize; ySrc++, yDst-- )
-	{
-		offsetDst = (yDst+y)*LCD_WIDTH/2+x/2;
-		offsetSrc = ySrc*xsize/2;
-		for( xSrc=0; xSrc<xsize/2; xSrc++ )
-			lcd_buffer[offsetDst+xSrc] = ~bmp[offsetSrc+xSrc];
-	}
+    for( i=0; i<firemen.num_plots; i++ ) firemen.layers[i] = LCD_SPRITE_NONE;
+    for( i=0; i<dummy.num_plots; i++ ) dummy.layers[i] = LCD_SPRITE_NONE;
+    for( i=0; i<crash.num_plots; i++ ) crash.layers[i] = LCD_SPRITE_NONE;
+    for( i=0; i<life.num_plots; i++ ) life.layers[i] = LCD_SPRITE_NONE;
+    lcd_sprites_init( landscapeBmp );
 }
 
 /*
-** Borra una porcin de la pantalla de tamao (xsize, ysize) pxeles desde la posicin (x,y)
-** Esta funcin es una generalizacin de lcd_clear
+** Un fichero que falte o sea de una versin anterior de bmp2spr se rechaza en vez de pintarse como basura
 */
-void lcd_clearWindow( uint16 x, uint16 y, uint16 xsize, uint16 ysize )
+boolean graphics_load( void )
 {
-	uint16 xi, yi;
-
-	for( yi=y; yi<y+ysize; yi++ )
-		for( xi=x; xi<x+xsize; xi++ )
-			lcd_putpixel( xi, yi, WHITE );
+    landscapeBmp = lcd_loadBitmap( LANDSCAPE );
+    firemenBmp   = lcd_loadBitmap( FIREMEN );
+    crashBmp     = lcd_loadBitmap( CRASH );
+    dummyBmp     = lcd_loadBitmap( DUMMY );
+    lifeBmp      = lcd_loadBitmap( LIFE );
+    return landscapeBmp && firemenBmp && crashBmp && dummyBmp && lifeBmp;
 }
 
 /*******************************************************************/
@@ -39,7 +39,7 @@
 void adc_init( void );
 
 /* 
-** Enciende el conversor A/D
+** Enciende el conversor A/D sin esperar a que se estabilice (lo hace la siguiente lectura)
 */
 void adc_on( void );
 
@@ -55,9 +55,25 @@ uint8 adc_status( void );
 
 /*
 ** Devuelve la media de 5 lecturas consecutivas del conversor A/D
+** Espera de forma activa el tiempo de estabilizacin, por lo que puede llamarse tambin desde RTIs
+** Si hay una lectura no bloqueante pendiente, esta vuelve a esperar la estabilizacin de su canal
+** Si una RTI hace otra lectura mientras tanto, la interrumpida se repite y conserva su canal
 */
 uint16 adc_getSample( uint8 ch );
 
+/*
+** Versin no bloqueante de adc_getSample: selecciona el canal y vuelve enseguida
+** Pasado el tiempo de estabilizacin hace las lecturas en la RTI del timer5 y llama a callback con la media
+** Solo puede haber una lectura no bloqueante pendiente: devuelve FALSE (sin lanzarla) si ya hay otra
+** Si hay lecturas bloqueantes en curso la estabilizacin empieza cuando terminan
+*/
+boolean adc_getSample_async( uint8 ch, void (*callback)( uint16 sample ) );
+
+/*
+** Indica si hay una lectura no bloqueante pendiente o alguna bloqueante en curso
+*/
+boolean adc_busy( void );
+
 /* 
 ** Instala, en la tabla de vectores de interrupcin, la funcin isr como RTI de interrupciones por fin de conversin A/D
 ** Borra interrupciones pendientes por fin de conversin A/D
@@ -41,7 +41,7 @@
 
 /*
 ** Inicializa los pulsadores
-** Inicializa timers
+** La aplicacin debe haber llamado antes a timers_init
 */
 void pbs_init( void );
 
@@ -70,6 +70,14 @@ uint8 pb_getchartime( uint16 *ms );
 */
 uint8 pb_timeout_getchar( uint16 ms );
 
+/*
+** Versin no bloqueante de pb_getchar: vuelve enseguida y, tras la presin y depresin de un pulsador,
+** llama a callback con su scancode desde la RTI del timer5
+** Los retardos de rebote no bloquean; mientras tanto los pulsadores se muestrean cada 10 ms
+** Una nueva llamada sustituye a la peticin en curso
+*/
+void pb_getchar_async( void (*callback)( uint8 scancode ) );
+
 /* 
 ** Instala, en la tabla de vectores de interrupcin, la funcin isr como RTI de interrupciones por presin de un pulsador
 ** Borra interrupciones pendientes por presin de un pulsador
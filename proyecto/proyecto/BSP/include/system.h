@@ -92,8 +92,16 @@ void sys_init( void );
 
 /*
 **  Pone el procesador en estado IDLE
+**  Si hay una funcin de reposo instalada la llama justo antes
+**  Puede llamarse con las interrupciones deshabilitadas (INT_DISABLE): cualquier peticin no enmascarada en INTMSK
+**  despierta a la CPU y se atiende al volver a habilitarlas, lo que permite comprobar sin carreras si hay trabajo
 */
-inline void sleep( void );
+void sleep( void );
+
+/*
+**  Instala la funcin a la que llama sleep() antes de pasar a IDLE (NULL para ninguna)
+*/
+void sys_idle_hook( void (*hook)(void) );
 
 /*
 **  Devuelve un puntero al comienzo de una regin libre y contigua de memoria del tamao indicado
@@ -33,6 +33,7 @@
 
 /* 
 ** Inicializa y calibra la touchscreen
+** La aplicacin debe haber llamado antes a timers_init
 */
 void ts_init( void );
 
@@ -72,6 +73,14 @@ void ts_getpostime( uint16 *x, uint16 *y, uint16 *ms );
 
 uint8 ts_timeout_getpos( uint16 *x, uint16 *y, uint16 ms );
 
+/*
+** Versin no bloqueante de ts_getpos: vuelve enseguida y, tras la pulsacin y despulsacin de la touchscreen,
+** llama a callback con la posicin desde la RTI del timer5
+** Ni los retardos de rebote ni las lecturas del ADC bloquean; mientras tanto la touchscreen se muestrea cada 10 ms
+** Una nueva llamada sustituye a la peticin en curso
+*/
+void ts_getpos_async( void (*callback)( uint16 x, uint16 y ) );
+
 /* 
 ** Instala, en la tabla de vectores de interrupcin, la funcin isr como RTI de interrupciones por pulsacin de la touchscreen
 ** Borra interrupciones pendientes por pulsacin de la touchscreen
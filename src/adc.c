@@ -1,22 +1,38 @@
 #include <s3c44b0x.h>
 #include <s3cev40.h>
+#include <system.h>
 #include <timers.h>
+#include <swtimers.h>
 #include <adc.h>
 
+#define ADC_SETTLE_MS (10)  // tiempo de estabilizacin tras encender o cambiar de canal
+
 static uint8 state;
+static swtimer_t settle;
+static volatile boolean async_pending = FALSE;    // hay una lectura no bloqueante esperando a que venza settle
+static volatile uint8 depth = 0;    // lecturas bloqueantes en curso (ms de una si una RTI interrumpe a otra)
+static volatile uint8 reads = 0;    // nmero de secuencia de la ltima lectura bloqueante iniciada
+static uint8 sample_ch;             // canal de la lectura no bloqueante pendiente
+static void (*sample_callback)( uint16 sample );
 
 extern void isr_ADC_dummy( void );
 
+static uint16 adc_convert( void );
+static void adc_sample_done( void *arg );
+
 void adc_init( void )
 {
     ADCPSR = 19;
+    swtimer_init( &settle, adc_sample_done, NULL );
     adc_off();
 }
 
+/*
+** Cualquier lectura espera ADC_SETTLE_MS tras seleccionar el canal, lo que cubre tambin la estabilizacin del encendido
+*/
 void adc_on( void )
 {
     ADCCON &= ~(1<<5);
-    sw_delay_ms( 10 );
     state = ON;
 }
 
@@ -31,13 +47,93 @@ uint8 adc_status( void )
     return state;
 }
 
+/*
+** La espera es por software para que pueda llamarse desde RTIs y funciones de vencimiento, que no dejan avanzar
+** a los temporizadores software; mientras haya lecturas bloqueantes la no bloqueante pendiente queda suspendida
+** y la ms externa la vuelve a lanzar al terminar
+** Si una RTI hace otra lectura entremedias cambia reads: la interrumpida se repite y la de la RTI restaura el canal
+*/
 uint16 adc_getSample( uint8 ch )
+{
+    uint16 sample;
+    uint32 saved;
+    uint8 seq;
+
+    INT_DISABLE;
+    saved = ADCCON & (7<<2);
+    if( !depth++ && async_pending )
+        swtimer_stop( &settle );
+    INT_ENABLE;
+
+    do {
+        INT_DISABLE;
+        seq = ++reads;
+        ADCCON = (ADCCON& ~(7<<2)) | ch<<2;
+        INT_ENABLE;
+        sw_delay_ms( ADC_SETTLE_MS );
+        sample = adc_convert();
+    } while( seq != reads );
+
+    INT_DISABLE;
+    if( !--depth && async_pending )
+    {
+        ADCCON = (ADCCON& ~(7<<2)) | sample_ch<<2;
+        swtimer_start( &settle, ADC_SETTLE_MS, TIMER_ONE_SHOT );
+    }
+    else
+        ADCCON = (ADCCON& ~(7<<2)) | saved;
+    INT_ENABLE;
+    return sample;
+}
+
+/*
+** Si hay lecturas bloqueantes en curso solo se registra: la ms externa selecciona el canal y arranca settle al terminar
+*/
+boolean adc_getSample_async( uint8 ch, void (*callback)( uint16 sample ) )
+{
+    INT_DISABLE;
+    if( async_pending )
+    {
+        INT_ENABLE;
+        return FALSE;
+    }
+    async_pending = TRUE;
+    sample_ch = ch;
+    sample_callback = callback;
+    if( !depth )
+    {
+        ADCCON = (ADCCON& ~(7<<2)) | ch<<2;
+        swtimer_start( &settle, ADC_SETTLE_MS, TIMER_ONE_SHOT );
+    }
+    INT_ENABLE;
+    return TRUE;
+}
+
+boolean adc_busy( void )
+{
+    return async_pending || depth;
+}
+
+/*
+** async_pending se borra antes de llamar a callback para que este pueda encadenar otra lectura
+*/
+static void adc_sample_done( void *arg )
+{
+    uint16 sample;
+
+    sample = adc_convert();
+    async_pending = FALSE;
+    sample_callback( sample );
+}
+
+/*
+** Devuelve la media de 5 conversiones del canal seleccionado (unos 50 us en total)
+*/
+static uint16 adc_convert( void )
 {
     uint32 sample;
     uint8 i;
-    
-    ADCCON = (ADCCON& ~(7<<2)) | ch<<2;
-    sw_delay_ms( 10 );
+
     for( i=0, sample=0; i<5; i++ )
     {
         ADCCON = ADCCON |(1<<0);
@@ -1,8 +1,40 @@
 #include <s3c44b0x.h>
 #include <s3cev40.h>
+#include <system.h>
 #include <dma.h>
 
 extern void isr_BDMA0_dummy( void ); 
+extern void isr_ZDMA0_dummy( void );
+extern void isr_ZDMA1_dummy( void );
+
+typedef struct {
+    uint32 src;
+    uint32 dst;
+    uint32 count;
+    uint8  size;
+    uint8  fill;
+    void (*callback)(void);
+} zdma_req_t;
+
+typedef struct {
+    volatile uint32 *con;           // ZDCONn, ZDISRCn, ZDIDESn y ZDICNTn son consecutivos
+    uint32 pattern;                 // origen fijo de los rellenos en curso
+    boolean allocated;
+    volatile boolean running;
+    uint16 head;
+    uint16 tail;
+    volatile uint16 size;
+    zdma_req_t queue[ZDMA_QUEUE_LEN];
+} zdma_chan_t;
+
+static zdma_chan_t zdma[2];
+
+static void isr_zdma0( void ) __attribute__ ((interrupt ("IRQ")));
+static void isr_zdma1( void ) __attribute__ ((interrupt ("IRQ")));
+
+static boolean zdma_enqueue( uint8 ch, zdma_req_t *req );
+static void zdma_start( zdma_chan_t *c );
+static void zdma_done( zdma_chan_t *c );
 
 void bdma0_init( void )
 {
@@ -24,3 +56,178 @@ void bdma0_close( void )
     INTMSK    |= BIT_BDMA0;
     pISR_BDMA0 = isr_BDMA0_dummy;
 }
+
+void zdma_init( void )
+{
+    uint8 i;
+
+    zdma[0].con = &ZDCON0;
+    zdma[1].con = &ZDCON1;
+    for( i=0; i<2; i++ )
+    {
+        zdma[i].con[0] = 0;
+        zdma[i].con[1] = 0;
+        zdma[i].con[2] = 0;
+        zdma[i].con[3] = 0;
+        zdma[i].allocated = FALSE;
+        zdma[i].running = FALSE;
+        zdma[i].head = 0;
+        zdma[i].tail = 0;
+        zdma[i].size = 0;
+    }
+
+    pISR_ZDMA0 = (uint32) isr_zdma0;
+    pISR_ZDMA1 = (uint32) isr_zdma1;
+    I_ISPC     = BIT_ZDMA0 | BIT_ZDMA1;
+    INTMSK    &= ~(BIT_GLOBAL | BIT_ZDMA0 | BIT_ZDMA1);
+}
+
+uint8 zdma_alloc( void )
+{
+    uint8 i;
+
+    for( i=0; i<2; i++ )
+        if( !zdma[i].allocated )
+        {
+            zdma[i].allocated = TRUE;
+            return i;
+        }
+    return ZDMA_NONE;
+}
+
+void zdma_free( uint8 ch )
+{
+    if( ch > ZDMA1 )
+        return;
+    while( zdma_busy( ch ) );
+    zdma[ch].allocated = FALSE;
+}
+
+boolean zdma_memcpy( uint8 ch, void *dst, const void *src, uint32 n, uint8 size, void (*callback)(void) )
+{
+    zdma_req_t req;
+
+    req.src = (uint32) src;
+    req.dst = (uint32) dst;
+    req.count = n;
+    req.size = size;
+    req.fill = FALSE;
+    req.callback = callback;
+    return zdma_enqueue( ch, &req );
+}
+
+boolean zdma_memset( uint8 ch, void *dst, uint32 pattern, uint32 n, uint8 size, void (*callback)(void) )
+{
+    zdma_req_t req;
+
+    if( size == ZDMA_8BIT )
+        pattern = (pattern & 0xff) * 0x01010101;
+    else if( size == ZDMA_16BIT )
+        pattern = (pattern & 0xffff) * 0x00010001;
+
+    req.src = pattern;
+    req.dst = (uint32) dst;
+    req.count = n;
+    req.size = size;
+    req.fill = TRUE;
+    req.callback = callback;
+    return zdma_enqueue( ch, &req );
+}
+
+boolean zdma_busy( uint8 ch )
+{
+    if( ch > ZDMA1 )
+        return FALSE;
+    return zdma[ch].running || zdma[ch].size;
+}
+
+/*
+** Valida la peticin y la aade a la cola del canal; si el canal est parado la lanza
+** La cola se comparte con la RTI del canal (y con las funciones de terminacin, que pueden encolar), por eso
+** se deshabilitan las interrupciones desde que se comprueba si hay hueco hasta que se actualiza la cola
+*/
+static boolean zdma_enqueue( uint8 ch, zdma_req_t *req )
+{
+    zdma_chan_t *c;
+    uint32 align;
+
+    if( ch > ZDMA1 || !req->count || req->count > ZDMA_MAX_COUNT )
+        return FALSE;
+    align = (req->size == ZDMA_BURST) ? 15 : (1 << req->size) - 1;
+    if( (req->dst & (req->size == ZDMA_BURST ? 3 : align)) || (req->count & align) || (!req->fill && (req->src & (req->size == ZDMA_BURST ? 3 : align))) )
+        return FALSE;
+
+    c = &zdma[ch];
+    INT_DISABLE;
+    if( c->size == ZDMA_QUEUE_LEN )
+    {
+        INT_ENABLE;
+        return FALSE;
+    }
+    c->queue[c->tail] = *req;
+    if( ++c->tail == ZDMA_QUEUE_LEN )
+        c->tail = 0;
+    c->size++;
+    if( !c->running )
+        zdma_start( c );
+    INT_ENABLE;
+    return TRUE;
+}
+
+/*
+** Programa y lanza la peticin de la cabeza de la cola
+**   ZDISRC: tamao de dato [31:30], direccin del origen [29:28] (01 incremento, 11 fijo)
+**   ZDIDES: rfaga de 4 palabras [31:30], direccin del destino [29:28]
+**   ZDICNT: modo whole service [27:26], interrupcin al terminar [23:22], habilitacin [20], bytes [19:0]
+**   ZDCON:  comando de comienzo [1:0]
+*/
+static void zdma_start( zdma_chan_t *c )
+{
+    zdma_req_t *req;
+    uint32 size;
+
+    req = &c->queue[c->head];
+    size = (req->size == ZDMA_BURST) ? ZDMA_32BIT : req->size;
+
+    if( req->fill )
+    {
+        c->pattern = req->src;
+        c->con[1] = (size << 30) | (3 << 28) | (uint32) &c->pattern;
+    }
+    else
+        c->con[1] = (size << 30) | (1 << 28) | req->src;
+    c->con[2] = ((req->size == ZDMA_BURST) ? (2 << 30) : 0) | (1 << 28) | req->dst;
+    c->con[3] = (3 << 26) | (3 << 22) | (1 << 20) | req->count;
+    c->running = TRUE;
+    c->con[0] = 1;
+}
+
+/*
+** Retira la peticin terminada, lanza la siguiente y notifica la terminacin
+*/
+static void zdma_done( zdma_chan_t *c )
+{
+    void (*callback)(void);
+
+    callback = c->queue[c->head].callback;
+    if( ++c->head == ZDMA_QUEUE_LEN )
+        c->head = 0;
+    c->size--;
+    c->running = FALSE;
+    if( c->size )
+        zdma_start( c );
+    if( callback )
+        callback();
+}
+
+static void isr_zdma0( void )
+{
+    zdma_done( &zdma[0] );
+    I_ISPC = BIT_ZDMA0;
+}
+
+static void isr_zdma1( void )
+{
+    zdma_done( &zdma[1] );
+    I_ISPC = BIT_ZDMA1;
+}
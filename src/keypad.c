@@ -1,6 +1,8 @@
 #include <s3c44b0x.h>
 #include <s3cev40.h>
+#include <system.h>
 #include <timers.h>
+#include <swtimers.h>
 #include <keypad.h>
 
 extern void isr_KEYPAD_dummy( void );
@@ -83,11 +85,18 @@ void keypad_close( void )
 
 #if KEYPAD_IO_METHOD == POOLING
 
+#define KEYPAD_POLL_MS (10)     // periodo de muestreo de keypad_getchar_async mientras espera la presin o depresin
+
+static swtimer_t keypad_timer;
+static enum { wait_keydown, keydown_delay, wait_keyup, keyup_delay } keypad_state;
+static uint8 keypad_code;
+static void (*keypad_callback)( uint8 scancode );
+
+static void keypad_step( void *arg );
 
 void keypad_init( void )
 {
-    timers_init();
-
+    swtimer_init( &keypad_timer, keypad_step, NULL );
 };
 
 uint8 keypad_getchar( void )
@@ -137,19 +146,65 @@ uint8 keypad_timeout_getchar( uint16 ms ) // falla todavia
 
 }
 
+void keypad_getchar_async( void (*callback)( uint8 scancode ) )
+{
+    INT_DISABLE;
+    keypad_callback = callback;
+    keypad_state = wait_keydown;
+    swtimer_start( &keypad_timer, KEYPAD_POLL_MS, TIMER_ONE_SHOT );
+    INT_ENABLE;
+}
+
+/*
+** Cada paso se ejecuta en la RTI del timer5 y programa el siguiente; sigue los mismos pasos que keypad_getchar
+*/
+static void keypad_step( void *arg )
+{
+    switch( keypad_state )
+    {
+        case wait_keydown:
+            if( keypad_scan() != KEYPAD_FAILURE )
+            {
+                keypad_state = keydown_delay;
+                swtimer_start( &keypad_timer, KEYPAD_KEYDOWN_DELAY, TIMER_ONE_SHOT );
+                return;
+            }
+            break;
+        case keydown_delay:
+            keypad_code = keypad_scan();
+            keypad_state = wait_keyup;
+            break;
+        case wait_keyup:
+            if( keypad_scan() == KEYPAD_FAILURE )
+            {
+                keypad_state = keyup_delay;
+                swtimer_start( &keypad_timer, KEYPAD_KEYUP_DELAY, TIMER_ONE_SHOT );
+                return;
+            }
+            break;
+        case keyup_delay:
+            keypad_callback( keypad_code );
+            return;
+    }
+    swtimer_start( &keypad_timer, KEYPAD_POLL_MS, TIMER_ONE_SHOT );
+}
+
 #elif KEYPAD_IO_METHOD == INTERRUPT
 
 static uint8 key = KEYPAD_FAILURE;
+static swtimer_t debounce_down;	// los retardos de rebote usan temporizadores software, no el timer0
+static swtimer_t debounce_up;
 
 static void keypad_down_isr( void ) __attribute__ ((interrupt ("IRQ")));
-static void timer0_down_isr( void ) __attribute__ ((interrupt ("IRQ")));
+static void keypad_down_timeout( void *arg );
 static void keypad_up_isr( void ) __attribute__ ((interrupt ("IRQ")));
-static void timer0_up_isr( void ) __attribute__ ((interrupt ("IRQ")));
+static void keypad_up_timeout( void *arg );
 
 void keypad_init( void )
 {
     EXTINT = (EXTINT & ~(0xf<<4)) | (2<<4);	// Falling edge tiggered
-    timers_init();
+    swtimer_init( &debounce_down, keypad_down_timeout, NULL );
+    swtimer_init( &debounce_up, keypad_up_timeout, NULL );
     keypad_open( keypad_down_isr );
 };
 
@@ -165,31 +220,29 @@ uint8 keypad_getchar( void )
 
 static void keypad_down_isr( void )
 {
-	timer0_open_ms( timer0_down_isr, KEYPAD_KEYDOWN_DELAY, TIMER_ONE_SHOT );
+	swtimer_start( &debounce_down, KEYPAD_KEYDOWN_DELAY, TIMER_ONE_SHOT );
 	INTMSK   |= BIT_KEYPAD;
 	I_ISPC	  = BIT_KEYPAD;
 }
 
-static void timer0_down_isr( void )
+static void keypad_down_timeout( void *arg )
 {
 	key = keypad_scan();
 	EXTINT = (EXTINT & ~(0xf<<4)) | (4<<4);
 	keypad_open( keypad_up_isr );
-	I_ISPC = BIT_TIMER0;
 }
 
 static void keypad_up_isr( void )
 {
-	timer0_open_ms( timer0_up_isr, KEYPAD_KEYUP_DELAY, TIMER_ONE_SHOT );
+	swtimer_start( &debounce_up, KEYPAD_KEYUP_DELAY, TIMER_ONE_SHOT );
 	INTMSK   |= BIT_KEYPAD;
 	I_ISPC	  = BIT_KEYPAD;
 }
 
-static void timer0_up_isr( void )
+static void keypad_up_timeout( void *arg )
 {
 	EXTINT = (EXTINT & ~(0xf<<4)) | (2<<4);
 	keypad_open( keypad_down_isr );
-	I_ISPC = BIT_TIMER0;
 }
 
 #else
@@ -2,10 +2,191 @@
 #include <lcd.h>
 
 extern uint8 font[];
-static uint8 lcd_buffer[LCD_BUFFER_SIZE];
+static uint8 lcd_buffer[2][LCD_BUFFER_SIZE] __attribute__ ((aligned (4)));
+
+static uint8 *lcd_front;    // buffer que barre el controlador
+static uint8 *lcd_back;     // buffer sobre el que se dibuja
+static uint8 buffering;
+static uint8 gray16_buffering;    // modo de buffering que se restaura al volver a LCD_GRAY16
+static uint32 lcd_stride;   // bytes por fila del buffer (mayor que LCD_WIDTH/2 con una pantalla virtual)
+static uint16 lcd_vwidth, lcd_vheight;
+static uint16 pan_x, pan_y; // esquina de la pantalla virtual que muestra el panel
+static uint8 lcd_bpp;       // bits por pixel del buffer que barre el controlador (el de dibujo siempre es de 4)
+static uint8 depth_pack[256];   // reduce los 2 pixeles de un byte de 4b/px a 2*lcd_bpp bits
+static lcd_surface_t screen;    // superficie del buffer de dibujo de la pantalla
+static lcd_surface_t *target;   // superficie sobre la que dibujan las primitivas
+static uint8 lcd_bg[LCD_BUFFER_SIZE] __attribute__ ((aligned (4)));    // copia del fondo con el mismo formato que la pantalla
+static boolean lcd_bg_valid;
+
+static uint32 dirty[LCD_DIRTY_ROWS][2];    // bitmap de teselas modificadas desde el ultimo flip/flush
 
 static uint8 state;
 
+typedef struct {
+    uint32 key;                 // caracter, colores y bit de validez
+    uint32 rows[16];            // 16 filas de 8 pixeles (una palabra por fila)
+} glyph_x1_t;
+
+typedef struct {
+    uint32 key;
+    uint32 rows[16][2];         // 16 filas de 16 pixeles; cada fila se pinta dos veces
+} glyph_x2_t;
+
+static glyph_x1_t glyph_x1[LCD_GLYPH_CACHE_X1];
+static glyph_x2_t glyph_x2[LCD_GLYPH_CACHE_X2];
+
+typedef struct {
+    char text[LCD_TEXT_LEN+1];
+    uint8 color;
+    uint8 scale;                // 0 si la entrada est libre
+    uint32 offset;              // posicin de la cadena pintada en text_pool
+    uint32 size;                // bytes que ocupa (mltiplo de 4)
+    uint32 used;                // valor de text_clock en el ltimo uso (LRU)
+} text_run_t;
+
+static text_run_t text_runs[LCD_TEXT_RUNS];
+static uint8 text_pool[LCD_TEXT_CACHE] __attribute__ ((aligned (4)));   // cadenas pintadas a 4b/px, contiguas desde el principio
+static uint32 text_pool_used;
+static uint32 text_clock;
+typedef struct {
+    const uint8 *src;           // siguiente byte del flujo comprimido
+    uint8 count;                // bytes pendientes del paquete en curso
+    boolean run;                // el paquete en curso es una repeticin de value
+    uint8 value;
+} rle_t;
+
+typedef struct {
+    uint16 x0, y0;              // esquina superior izquierda (incluida)
+    uint16 x1, y1;              // esquina inferior derecha (excluida)
+} rect_t;
+
+typedef struct {
+    lcd_bitmap_t *bmp;
+    uint8 *mask;                // nibbles a 0xf en los pixeles opacos (NULL si es opaco)
+    uint16 x, y;
+    uint8 z;
+    uint8 key;
+    uint8 orient;               // orientacin normalizada (giro LCD_ROT_* y, opcionalmente, LCD_MIRROR_H)
+    boolean used;
+    boolean visible;
+} layer_t;
+
+typedef struct {
+    lcd_bitmap_t *bmp;
+    uint8 key;
+    uint8 *mask;
+} layer_mask_t;
+
+static layer_t layers[LCD_SPRITES];
+static uint8 layer_order[LCD_SPRITES];     // identificadores de los sprites ordenados por z creciente
+static uint8 layer_count;
+static layer_mask_t layer_masks[LCD_SPRITE_MASKS];
+static uint8 mask_pool[LCD_SPRITE_MASK_POOL] __attribute__ ((aligned (4)));
+static uint32 mask_used;
+static rect_t damage[LCD_SPRITE_DAMAGE];   // zonas a recomponer en el proximo lcd_sprites_render
+static uint8 damage_count;
+
+#define DL_BOX      (0)
+#define DL_FILL     (1)
+#define DL_TEXT     (2)
+#define DL_BITMAP   (3)
+
+typedef struct {
+    uint8 type;
+    uint8 color;                // color de la caja, relleno o texto; orientacin del bitmap
+    uint16 arg;                 // grosor de la caja o escala del texto
+    uint16 x, y;                // posicin con la que se llama a la primitiva
+    rect_t r;                   // zona que pinta la orden (para eliminar las tapadas)
+    void *data;                 // cadena copiada en dl_text o bitmap
+} dl_cmd_t;
+
+static dl_cmd_t dl[LCD_DL_COMMANDS];       // rdenes del frame en curso en orden de llegada
+static uint8 dl_count;
+static char dl_text[LCD_DL_TEXT];
+static uint16 dl_text_used;
+
+static char con_text[LCD_CONSOLE_HISTORY][LCD_CONSOLE_COLS];    // anillo con las ltimas lneas de la consola
+static uint32 con_line;     // nmero de la lnea del cursor desde lcd_console_init
+static uint8 con_col;
+static uint8 con_color;
+static uint16 con_back;     // lneas que se muestran por encima de la ltima (0 = se sigue la salida)
+static boolean con_active;
+
+static const uint32 field_pow10[LCD_FIELD_DIGITS+1] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000, 0
+};
+
+static uint32 glyph_mask[256];  // expande cada bit de un byte de la fuente a un nibble (orden de pixeles del buffer)
+
+static const uint8 glyph_double[16] = {    // duplica cada bit de 4 bits de la fuente (escala x2)
+    0x00, 0x03, 0x0c, 0x0f, 0x30, 0x33, 0x3c, 0x3f,
+    0xc0, 0xc3, 0xcc, 0xcf, 0xf0, 0xf3, 0xfc, 0xff
+};
+
+static void lcd_wait_frame( void );
+static void lcd_set_address( uint8 *buffer );
+
+static void lcd_setpixel( uint16 x, uint16 y, uint8 c );
+static boolean lcd_clip_rect( uint16 x, uint16 y, uint16 xsize, uint16 ysize, rect_t *r );
+static inline void lcd_mark( uint16 x, uint16 y, uint16 xsize, uint16 ysize );
+static void lcd_dirty( uint16 x, uint16 y, uint16 xsize, uint16 ysize );
+static void lcd_dirty_copy( uint8 *dst, const uint8 *src );
+static void lcd_pack( uint8 *dst, const uint8 *src, uint16 x, uint16 xsize, uint16 y, uint16 ysize );
+
+static void lcd_blit( uint8 *dst, int32 dstStride, uint16 dx, const uint8 *src, int32 srcStride, uint16 sx, uint16 xsize, uint16 ysize, uint32 xmask );
+static void lcd_blit_row( uint8 *dst, uint16 dx, const uint8 *src, uint16 sx, uint16 n, uint32 xmask );
+
+static void lcd_fill( uint16 x, uint16 y, uint16 xsize, uint16 ysize, uint8 color );
+static void lcd_fill_row( uint8 *row, uint16 x, uint16 n, uint32 pattern );
+static void lcd_span( int32 x0, int32 x1, int32 y, uint8 color );
+static void lcd_ellipse_row( fix32 xc, fix32 yc, fix32 rx, fix32 ry, int32 y, int32 *left, int32 *right );
+static uint32 lcd_isqrt( uint32 n );
+
+static void lcd_unpack( uint8 *dst, int32 dstStride, uint16 dx, const lcd_bitmap_t *bmp, uint16 sx, uint16 sy, uint16 xsize, uint16 ysize );
+static void lcd_rle_row( rle_t *rle, uint8 *dst, uint16 dx, uint16 sx, uint16 n, uint16 bytes );
+
+static void lcd_glyph_init( void );
+static void lcd_blit_row_masked( uint8 *dst, uint16 dx, const uint8 *src, const uint8 *mask, uint16 sx, uint16 n );
+static inline uint32 blit_fetch( const uint8 *src, uint16 sx );
+static inline uint32 blit_reverse( uint32 w );
+static void lcd_blit_row_orient( uint8 *dst, uint16 dx, uint16 n, const lcd_bitmap_t *bmp, const uint8 *mask, uint8 orient, uint16 u, uint16 v );
+static inline uint8 orient_normalize( uint8 orient );
+static inline uint16 orient_width( const lcd_bitmap_t *bmp, uint8 orient );
+static inline uint16 orient_height( const lcd_bitmap_t *bmp, uint8 orient );
+static uint8 *lcd_sprite_mask( lcd_bitmap_t *bmp, uint8 key );
+static void lcd_sprite_damage( uint8 id );
+static void lcd_damage( uint16 x, uint16 y, uint16 xsize, uint16 ysize );
+static void lcd_putglyph( uint16 x, uint16 y, uint8 color, uint8 bgcolor, uint8 ch, uint8 scale );
+static void lcd_text( uint16 x, uint16 y, uint8 color, const char *s, uint8 scale );
+static void lcd_text_glyphs( uint16 x, uint16 y, uint8 color, const char *s, uint8 scale );
+static text_run_t *lcd_text_add( const char *s, uint16 n, uint8 color, uint8 scale );
+static void lcd_text_evict( void );
+static void lcd_console_glyph( uint8 col, uint32 line, char ch );
+static void lcd_console_newline( void );
+static void lcd_console_show( void );
+static dl_cmd_t *lcd_dl_add( uint8 type, uint16 x, uint16 y, uint16 xsize, uint16 ysize );
+static void lcd_dl_text( uint16 x, uint16 y, uint8 color, const char *s, uint8 scale );
+static boolean lcd_dl_same( const dl_cmd_t *a, const dl_cmd_t *b );
+
+/*
+** Lectura/escritura de un pixel (nibble) dentro de una fila de 4b/px
+*/
+
+static inline uint8 nibble_get( const uint8 *row, uint16 x )
+{
+    return (x & 1) ? (row[x>>1] & 0xf) : (row[x>>1] >> 4);
+}
+
+static inline void nibble_put( uint8 *row, uint16 x, uint8 c )
+{
+    uint8 *p = row + (x>>1);
+
+    if( x & 1 )
+        *p = (*p & 0xf0) | c;
+    else
+        *p = (*p & 0x0f) | (c << 4);
+}
+
 void lcd_init( void )
 {      
 	DITHMODE = 0x12210;
@@ -26,10 +207,21 @@ void lcd_init( void )
 	LCDCON2  = 0x13cef;
 	LCDCON3  = 0x0;
 
-	LCDSADDR1 = (2 << 27) | ((uint32)lcd_buffer >> 1);
-	LCDSADDR2 = (1 << 29) | (((uint32)lcd_buffer + LCD_BUFFER_SIZE) & 0x3FFFFF) >> 1;
-	LCDSADDR3 = 0x50;
+	lcd_front = lcd_buffer[0];
+	lcd_back  = lcd_buffer[0];
+	buffering = LCD_SINGLE_BUFFER;
+	lcd_bpp = LCD_GRAY16;
+	lcd_stride  = LCD_WIDTH/2;
+	lcd_vwidth  = LCD_WIDTH;
+	lcd_vheight = LCD_HEIGHT;
+	pan_x = 0;
+	pan_y = 0;
+	lcd_surface_init( &screen, lcd_back, lcd_vwidth, lcd_vheight, lcd_stride );
+	target = &screen;
+
+	lcd_set_address( lcd_front );
     
+    lcd_glyph_init();
     lcd_off();
 }
 
@@ -50,38 +242,426 @@ uint8 lcd_status( void )
     return state;
 }
 
-void lcd_clear( void )
+void lcd_buffering( uint8 mode )
+{
+	if( lcd_stride*lcd_vheight > LCD_BUFFER_SIZE || lcd_bpp != LCD_GRAY16 )
+		return;
+	buffering = mode;
+	if( mode == LCD_SINGLE_BUFFER )
+	{
+		lcd_back = lcd_front;
+	}
+	else
+	{
+		lcd_back = (lcd_front == lcd_buffer[0]) ? lcd_buffer[1] : lcd_buffer[0];
+		lcd_blit( lcd_back, LCD_WIDTH/2, 0, lcd_front, LCD_WIDTH/2, 0, LCD_WIDTH, LCD_HEIGHT, 0 );
+	}
+	screen.base = lcd_back;
+	lcd_dirty_copy( NULL, NULL );
+}
+
+void lcd_flip( void )
+{
+	uint8 *aux;
+
+	switch( buffering )
+	{
+		case LCD_SINGLE_BUFFER:
+			lcd_dirty_copy( NULL, NULL );
+			break;
+		case LCD_OFFSCREEN:
+			lcd_flush();
+			break;
+		default:
+			lcd_wait_frame();
+			lcd_set_address( lcd_back );
+			aux = lcd_front;
+			lcd_front = lcd_back;
+			lcd_back = aux;
+			screen.base = lcd_back;
+			if( buffering == LCD_DOUBLE_COPY )
+				lcd_dirty_copy( lcd_back, lcd_front );    // el nuevo oculto solo difiere en lo modificado
+			else
+				lcd_dirty_copy( NULL, NULL );
+			break;
+	}
+}
+
+void lcd_flush( void )
+{
+	if( lcd_back != lcd_front )
+		lcd_dirty_copy( lcd_front, lcd_back );
+	else
+		lcd_dirty_copy( NULL, NULL );
+}
+
+/*
+** Con menos de 4b/px se dibuja en lcd_buffer[0] a 4b/px y el controlador barre una copia reducida en lcd_buffer[1]
+** (modo LCD_OFFSCREEN): las primitivas no cambian y lcd_flip/lcd_flush reducen solo las teselas modificadas
+*/
+boolean lcd_depth( uint8 bpp )
 {
 	uint16 i;
-	for(i = 0; i < LCD_BUFFER_SIZE; i++){
-		lcd_buffer[i] = 0;
+	uint8 hi, lo;
+
+	if( (bpp != LCD_MONO && bpp != LCD_GRAY4 && bpp != LCD_GRAY16) || lcd_vwidth != LCD_WIDTH || lcd_vheight != LCD_HEIGHT )
+		return FALSE;
+	if( bpp == lcd_bpp )
+		return TRUE;
+	if( lcd_back != lcd_buffer[0] )
+		lcd_blit( lcd_buffer[0], LCD_WIDTH/2, 0, lcd_back, LCD_WIDTH/2, 0, LCD_WIDTH, LCD_HEIGHT, 0 );
+	lcd_back = lcd_buffer[0];
+	screen.base = lcd_back;
+	if( lcd_bpp == LCD_GRAY16 )
+		gray16_buffering = buffering;
+	lcd_bpp = bpp;
+	if( bpp == LCD_GRAY16 )
+	{
+		buffering = LCD_SINGLE_BUFFER;
+		lcd_front = lcd_back;
+		lcd_dirty_copy( NULL, NULL );
+	}
+	else
+	{
+		if( bpp == LCD_GRAY4 )
+			BLUELUT = 0xfa50;                   // los 4 niveles se reparten entre los 16 grises del panel
+		for( i=0; i<256; i++ )
+		{
+			hi = (i >> 4) >> (4-bpp);           // se conservan los bits ms significativos de cada nivel de gris
+			lo = (i & 0xf) >> (4-bpp);
+			depth_pack[i] = (hi << bpp) | lo;
+		}
+		buffering = LCD_OFFSCREEN;
+		lcd_front = lcd_buffer[1];
+		lcd_dirty_copy( NULL, NULL );
+		lcd_pack( lcd_front, lcd_back, 0, LCD_WIDTH, 0, LCD_HEIGHT );
+	}
+	lcd_wait_frame();
+	lcd_set_address( lcd_front );
+	if( bpp == LCD_GRAY16 )
+		lcd_buffering( gray16_buffering );
+	return TRUE;
+}
+
+/*
+** Marca como modificadas las teselas de LCD_DIRTY_TILE x LCD_DIRTY_TILE pixeles que solapan el rectangulo
+*/
+static void lcd_dirty( uint16 x, uint16 y, uint16 xsize, uint16 ysize )
+{
+	uint16 xt0, xt1, yt0, yt1;
+	uint32 m0, m1;
+
+	if( !xsize || !ysize || x >= LCD_WIDTH || y >= LCD_HEIGHT )
+		return;
+
+	xt0 = x / LCD_DIRTY_TILE;
+	xt1 = (x + xsize - 1) / LCD_DIRTY_TILE;
+	yt0 = y / LCD_DIRTY_TILE;
+	yt1 = (y + ysize - 1) / LCD_DIRTY_TILE;
+	if( xt1 >= LCD_DIRTY_COLS )
+		xt1 = LCD_DIRTY_COLS-1;
+	if( yt1 >= LCD_DIRTY_ROWS )
+		yt1 = LCD_DIRTY_ROWS-1;
+
+	m0 = (xt0 < 32) ? (0xffffffff << xt0) & ((xt1 < 32) ? (0xffffffff >> (31-xt1)) : 0xffffffff) : 0;
+	m1 = (xt1 >= 32) ? (0xffffffff >> (63-xt1)) & ((xt0 >= 32) ? (0xffffffff << (xt0-32)) : 0xffffffff) : 0;
+
+	for( ; yt0 <= yt1; yt0++ )
+	{
+		dirty[yt0][0] |= m0;
+		dirty[yt0][1] |= m1;
+	}
+}
+
+/*
+** Copia de src a dst las teselas marcadas, agrupando las consecutivas de una fila en un solo rectangulo
+** Borra el bitmap de teselas modificadas (si dst es NULL solo lo borra)
+*/
+static void lcd_dirty_copy( uint8 *dst, const uint8 *src )
+{
+	uint16 row, t0, t1;
+	uint32 offset;
+
+	for( row=0; row<LCD_DIRTY_ROWS; row++ )
+	{
+		if( dst && (dirty[row][0] | dirty[row][1]) )
+		{
+			offset = row*LCD_DIRTY_TILE*(LCD_WIDTH/2);
+			for( t0=0; t0<LCD_DIRTY_COLS; t0=t1 )
+			{
+				if( !(dirty[row][t0 >> 5] & (1U << (t0 & 31))) )
+				{
+					t1 = t0+1;
+					continue;
+				}
+				for( t1=t0+1; t1<LCD_DIRTY_COLS && (dirty[row][t1 >> 5] & (1U << (t1 & 31))); t1++ );
+				if( lcd_bpp == LCD_GRAY16 )
+					lcd_blit( dst + offset, LCD_WIDTH/2, t0*LCD_DIRTY_TILE, src + offset, LCD_WIDTH/2, t0*LCD_DIRTY_TILE, (t1-t0)*LCD_DIRTY_TILE, LCD_DIRTY_TILE, 0 );
+				else
+					lcd_pack( dst, src, t0*LCD_DIRTY_TILE, (t1-t0)*LCD_DIRTY_TILE, row*LCD_DIRTY_TILE, LCD_DIRTY_TILE );
+			}
+		}
+		dirty[row][0] = 0;
+		dirty[row][1] = 0;
+	}
+}
+
+/*
+** Reduce a lcd_bpp bits por pixel la ventana (x y xsize mltiplos de 8) del buffer src de 4b/px en el buffer dst
+** Cada 8 pixeles (una palabra de src) dan 1 byte en monocromo y 2 con 4 grises
+*/
+static void lcd_pack( uint8 *dst, const uint8 *src, uint16 x, uint16 xsize, uint16 y, uint16 ysize )
+{
+	const uint8 *s;
+	uint8 *d;
+	uint16 n;
+
+	src += y*(LCD_WIDTH/2) + x/2;
+	dst += y*(LCD_WIDTH*lcd_bpp/8) + x*lcd_bpp/8;
+	for( ; ysize; ysize-- )
+	{
+		s = src;
+		d = dst;
+		if( lcd_bpp == LCD_MONO )
+			for( n = xsize/8; n; n--, s += 4 )
+				*d++ = (depth_pack[s[0]] << 6) | (depth_pack[s[1]] << 4) | (depth_pack[s[2]] << 2) | depth_pack[s[3]];
+		else
+			for( n = xsize/8; n; n--, s += 4 )
+			{
+				*d++ = (depth_pack[s[0]] << 4) | depth_pack[s[1]];
+				*d++ = (depth_pack[s[2]] << 4) | depth_pack[s[3]];
+			}
+		src += LCD_WIDTH/2;
+		dst += LCD_WIDTH*lcd_bpp/8;
+	}
+}
+
+/*
+** Espera a que el controlador barra la ultima linea del frame (LINECNT cuenta de LINEVAL a 0)
+** para que la nueva direccion de comienzo se cargue al inicio del siguiente frame
+*/
+static void lcd_wait_frame( void )
+{
+	if( !state )
+		return;
+	while( !((LCDCON1 >> 22) & 0x3ff) );
+	while( (LCDCON1 >> 22) & 0x3ff );
+}
+
+/*
+** El panel barre LCD_HEIGHT filas de LCD_WIDTH*lcd_bpp/16 medias palabras (PAGEWIDTH) saltando al final de cada una
+** las OFFSIZE medias palabras que la pantalla virtual tiene de ms; la esquina visible la fija pan_x/pan_y
+** MODESEL (monocromo, 4 o 16 grises) vale lcd_bpp/2; con menos de 4b/px no hay pantalla virtual
+*/
+static void lcd_set_address( uint8 *buffer )
+{
+	uint32 start, stride;
+
+	stride = (lcd_bpp == LCD_GRAY16) ? lcd_stride : LCD_WIDTH*lcd_bpp/8;
+	start = (uint32)buffer + pan_y*stride + (pan_x >> 1);
+	LCDSADDR1 = ((lcd_bpp >> 1) << 27) | (start >> 1);
+	LCDSADDR2 = (1 << 29) | ((start + stride*LCD_HEIGHT) & 0x3FFFFF) >> 1;
+	LCDSADDR3 = (((stride - LCD_WIDTH*lcd_bpp/8) >> 1) << 9) | (LCD_WIDTH*lcd_bpp/16);
+}
+
+boolean lcd_virtual( uint16 width, uint16 height )
+{
+	if( width < LCD_WIDTH || height < LCD_HEIGHT || (width & 7) || (uint32)width/2*height > LCD_VIRTUAL_SIZE || lcd_bpp != LCD_GRAY16 )
+		return FALSE;
+	lcd_buffering( LCD_SINGLE_BUFFER );
+	con_active = FALSE;
+	lcd_front = lcd_buffer[0];
+	lcd_back  = lcd_buffer[0];
+	lcd_stride  = width/2;
+	lcd_vwidth  = width;
+	lcd_vheight = height;
+	pan_x = 0;
+	pan_y = 0;
+	lcd_surface_init( &screen, lcd_back, lcd_vwidth, lcd_vheight, lcd_stride );
+	lcd_wait_frame();
+	lcd_set_address( lcd_front );
+	return TRUE;
+}
+
+void lcd_pan( uint16 x, uint16 y )
+{
+	if( x > lcd_vwidth - LCD_WIDTH )
+		x = lcd_vwidth - LCD_WIDTH;
+	if( y > lcd_vheight - LCD_HEIGHT )
+		y = lcd_vheight - LCD_HEIGHT;
+	pan_x = x & ~3;
+	pan_y = y;
+	lcd_wait_frame();
+	lcd_set_address( lcd_front );
+}
+
+void lcd_surface_init( lcd_surface_t *surface, uint8 *base, uint16 width, uint16 height, uint32 stride )
+{
+	surface->base = base;
+	surface->width = width;
+	surface->height = height;
+	surface->stride = stride;
+	surface->cx0 = 0;
+	surface->cy0 = 0;
+	surface->cx1 = width;
+	surface->cy1 = height;
+}
+
+lcd_surface_t *lcd_screen( void )
+{
+	return &screen;
+}
+
+void lcd_target( lcd_surface_t *surface )
+{
+	target = surface ? surface : &screen;
+}
+
+void lcd_clip( uint16 x, uint16 y, uint16 xsize, uint16 ysize )
+{
+	target->cx0 = (x < target->width) ? x : target->width;
+	target->cy0 = (y < target->height) ? y : target->height;
+	target->cx1 = ((uint32)x + xsize < target->width) ? x + xsize : target->width;
+	target->cy1 = ((uint32)y + ysize < target->height) ? y + ysize : target->height;
+}
+
+void lcd_unclip( void )
+{
+	lcd_clip( 0, 0, target->width, target->height );
+}
+
+void lcd_putSurface( lcd_surface_t *surface, uint16 x, uint16 y )
+{
+	rect_t r;
+
+	if( !lcd_clip_rect( x, y, surface->width, surface->height, &r ) )
+		return;
+	lcd_blit( target->base + r.y0*target->stride, target->stride, r.x0, surface->base + (r.y0-y)*surface->stride, surface->stride, r.x0-x, r.x1-r.x0, r.y1-r.y0, 0 );
+	lcd_mark( r.x0, r.y0, r.x1-r.x0, r.y1-r.y0 );
+}
+
+/*
+** Recorta el rectangulo indicado con el de recorte del destino; devuelve FALSE si no queda nada que pintar
+** Es el unico punto en el que se comprueban limites: los bucles internos trabajan ya sobre el rectangulo recortado
+*/
+static boolean lcd_clip_rect( uint16 x, uint16 y, uint16 xsize, uint16 ysize, rect_t *r )
+{
+	r->x0 = (x > target->cx0) ? x : target->cx0;
+	r->y0 = (y > target->cy0) ? y : target->cy0;
+	r->x1 = ((uint32)x + xsize < target->cx1) ? x + xsize : target->cx1;
+	r->y1 = ((uint32)y + ysize < target->cy1) ? y + ysize : target->cy1;
+	return r->x0 < r->x1 && r->y0 < r->y1;
+}
+
+/*
+** Registra las teselas modificadas solo si se ha dibujado sobre la pantalla
+*/
+static inline void lcd_mark( uint16 x, uint16 y, uint16 xsize, uint16 ysize )
+{
+	if( target == &screen )
+		lcd_dirty( x, y, xsize, ysize );
+}
+
+void lcd_clear( void )
+{
+	lcd_clear_color( WHITE );
+}
+
+void lcd_clear_color( uint8 color )
+{
+	uint32 *p;
+	uint32 pattern, i;
+
+	if( target->cx0 || target->cy0 || target->cx1 != target->width || target->cy1 != target->height || target->stride != target->width/2 )
+	{
+		lcd_fill( target->cx0, target->cy0, target->cx1 - target->cx0, target->cy1 - target->cy0, color );
+		return;
+	}
+	pattern = color * 0x11111111;
+	p = (uint32 *)target->base;
+	for( i = target->stride*target->height/16; i; i-- )
+	{
+		p[0] = pattern; p[1] = pattern; p[2] = pattern; p[3] = pattern;
+		p += 4;
 	}
+	for( i = (target->stride*target->height/4) & 3; i; i-- )
+		*p++ = pattern;
+	lcd_mark( 0, 0, target->width, target->height );
+}
+
+void lcd_clearWindow( uint16 x, uint16 y, uint16 xsize, uint16 ysize )
+{
+	lcd_fill( x, y, xsize, ysize, WHITE );
+}
+
+void lcd_setBackground( lcd_bitmap_t *bmp )
+{
+	uint16 xsize, ysize;
+	uint32 i;
+
+	lcd_bg_valid = (bmp != NULL);
+	if( !bmp )
+		return;
+	xsize = (bmp->width < LCD_WIDTH) ? bmp->width : LCD_WIDTH;
+	ysize = (bmp->height < LCD_HEIGHT) ? bmp->height : LCD_HEIGHT;
+	if( xsize < LCD_WIDTH || ysize < LCD_HEIGHT )
+		for( i=0; i<LCD_BUFFER_SIZE/4; i++ )
+			((uint32 *)lcd_bg)[i] = 0;
+	lcd_unpack( lcd_bg, LCD_WIDTH/2, 0, bmp, 0, 0, xsize, ysize );
+}
+
+void lcd_restoreWindow( uint16 x, uint16 y, uint16 xsize, uint16 ysize )
+{
+	uint16 i;
+
+	if( x >= LCD_WIDTH || y >= LCD_HEIGHT )
+		return;
+	if( x + xsize > LCD_WIDTH )
+		xsize = LCD_WIDTH - x;
+	if( y + ysize > LCD_HEIGHT )
+		ysize = LCD_HEIGHT - y;
+	if( !lcd_bg_valid )
+		for( i=0; i<ysize; i++ )
+			lcd_fill_row( lcd_back + (y+i)*lcd_stride, x, xsize, WHITE * 0x11111111 );
+	else
+		lcd_blit( lcd_back + y*lcd_stride, lcd_stride, x, lcd_bg + y*(LCD_WIDTH/2), LCD_WIDTH/2, x, xsize, ysize, 0 );
+	lcd_dirty( x, y, xsize, ysize );
 }
 
 void lcd_putpixel( uint16 x, uint16 y, uint8 c)
+{
+	if( x < target->cx0 || x >= target->cx1 || y < target->cy0 || y >= target->cy1 )
+		return;
+	lcd_setpixel( x, y, c );
+	lcd_mark( x, y, 1, 1 );
+}
+
+static void lcd_setpixel( uint16 x, uint16 y, uint8 c)
 {
     uint8 byte, bit;
-    uint16 i;
+    uint32 i;
 
-    i = x/2 + y*(LCD_WIDTH/2);
+    i = x/2 + y*target->stride;
     bit = (1-x%2)*4;
     
-    byte = lcd_buffer[i];
+    byte = target->base[i];
     byte &= ~(0xF << bit);
     byte |= c << bit;
-    lcd_buffer[i] = byte;
+    target->base[i] = byte;
 }
 
 uint8 lcd_getpixel( uint16 x, uint16 y )
 {
 	uint8 byte, bit;
-	uint16 i;
+	uint32 i;
 
-	i = x/2 + y*(LCD_WIDTH/2);
+	if( x >= target->width || y >= target->height )
+		return WHITE;
+	i = x/2 + y*target->stride;
 	bit = (1-x%2)*4;
 
-	byte = lcd_buffer[i];
-	return byte>>bit;
+	byte = target->base[i];
+	return (byte>>bit) & 0xf;
 	/*if(byte & (1 << bit)) {
 		return 1;
 	}
@@ -92,22 +672,12 @@ uint8 lcd_getpixel( uint16 x, uint16 y )
 
 void lcd_draw_hline( uint16 xleft, uint16 xright, uint16 y, uint8 color, uint16 width )
 {
-	uint16 i,j;
-    for(i = 0; i<width;i++){
-    	for(j = xleft; j<=xright;j++){
-    		lcd_putpixel(j,y+i,color);
-    	}
-    }
+	lcd_fill( xleft, y, xright-xleft+1, width, color );
 }
 
 void lcd_draw_vline( uint16 yup, uint16 ydown, uint16 x, uint8 color, uint16 width )
 {
-	uint16 i,j;
-	for(i = 0; i<width;i++){
-		for(j = yup; j<=ydown;j++){
-			lcd_putpixel(x+i,j,color);
-		}
-	}
+	lcd_fill( x, yup, width, ydown-yup+1, color );
 }
 
 void lcd_draw_box( uint16 xleft, uint16 yup, uint16 xright, uint16 ydown, uint8 color, uint16 width )
@@ -118,26 +688,315 @@ void lcd_draw_box( uint16 xleft, uint16 yup, uint16 xright, uint16 ydown, uint8
 	lcd_draw_vline(yup,ydown+width,xright,color,width);
 }
 
-void lcd_putchar( uint16 x, uint16 y, uint8 color, char ch )
+void lcd_fill_box( uint16 xleft, uint16 yup, uint16 xright, uint16 ydown, uint8 color )
 {
-    uint8 line, row;
-    uint8 *bitmap;
+	lcd_fill( xleft, yup, xright-xleft+1, ydown-yup+1, color );
+}
 
-    bitmap = font + ch*16;
-    for( line=0; line<16; line++ )
-        for( row=0; row<8; row++ )                    
-            if( bitmap[line] & (0x80 >> row) )
-                lcd_putpixel( x+row, y+line, color );
-            else
-                lcd_putpixel( x+row, y+line, WHITE );
+/*
+** Los pixeles se recorren en el eje mayor; la coordenada del eje menor en el centro de cada pixel se acumula en Q16
+** (equivale al trmino de error de Bresenham) y los pixeles consecutivos de una misma fila forman un solo span
+*/
+void lcd_draw_line( fix32 x0, fix32 y0, fix32 x1, fix32 y1, uint8 color )
+{
+	fix32 t, lo, hi, slope, v, adx, ady;
+	int32 c, c1, start, row;
+
+	adx = (x1 > x0) ? FSUB(x1,x0) : FSUB(x0,x1);
+	ady = (y1 > y0) ? FSUB(y1,y0) : FSUB(y0,y1);
+	if( adx >= ady )
+	{
+		if( x1 < x0 )
+		{
+			t = x0; x0 = x1; x1 = t;
+			t = y0; y0 = y1; y1 = t;
+		}
+		lo = FCONV( (y0 < y1) ? y0 : y1, LCD_FIX_Q, 16 );
+		hi = FCONV( (y0 < y1) ? y1 : y0, LCD_FIX_Q, 16 );
+		slope = (x1 == x0) ? 0 : FDIV( FSUB(y1,y0), FSUB(x1,x0), 16 );
+		c = x0 >> LCD_FIX_Q;
+		c1 = x1 >> LCD_FIX_Q;
+		if( c < target->cx0 )
+			c = target->cx0;
+		if( c1 >= target->cx1 )
+			c1 = target->cx1 - 1;
+		if( c > c1 )
+			return;
+		v = FCONV( y0, LCD_FIX_Q, 16 ) + FMUL( slope, FSUB( FADDI( LCD_FIX_HALF, c, LCD_FIX_Q ), x0 ), LCD_FIX_Q );
+		t = (v < lo) ? lo : (v > hi) ? hi : v;
+		row = t >> 16;
+		for( start = c++, v += slope; c <= c1; c++, v += slope )
+		{
+			t = (v < lo) ? lo : (v > hi) ? hi : v;
+			if( (t >> 16) != row )
+			{
+				lcd_span( start, c-1, row, color );
+				start = c;
+				row = t >> 16;
+			}
+		}
+		lcd_span( start, c1, row, color );
+	}
+	else
+	{
+		if( y1 < y0 )
+		{
+			t = x0; x0 = x1; x1 = t;
+			t = y0; y0 = y1; y1 = t;
+		}
+		lo = FCONV( (x0 < x1) ? x0 : x1, LCD_FIX_Q, 16 );
+		hi = FCONV( (x0 < x1) ? x1 : x0, LCD_FIX_Q, 16 );
+		slope = FDIV( FSUB(x1,x0), FSUB(y1,y0), 16 );
+		c = y0 >> LCD_FIX_Q;
+		c1 = y1 >> LCD_FIX_Q;
+		if( c < target->cy0 )
+			c = target->cy0;
+		if( c1 >= target->cy1 )
+			c1 = target->cy1 - 1;
+		v = FCONV( x0, LCD_FIX_Q, 16 ) + FMUL( slope, FSUB( FADDI( LCD_FIX_HALF, c, LCD_FIX_Q ), y0 ), LCD_FIX_Q );
+		for( ; c <= c1; c++, v += slope )
+		{
+			t = (v < lo) ? lo : (v > hi) ? hi : v;
+			lcd_span( t >> 16, t >> 16, c, color );
+		}
+	}
+}
+
+void lcd_draw_ellipse( fix32 xc, fix32 yc, fix32 rx, fix32 ry, uint8 color )
+{
+	int32 y, y1, l, r, lp, rp, ln, rn, a, b;
+
+	y = FSUB( yc, ry ) >> LCD_FIX_Q;
+	y1 = FADD( yc, ry ) >> LCD_FIX_Q;
+	if( y < target->cy0 - 1 )
+		y = target->cy0 - 1;
+	if( y1 > target->cy1 )
+		y1 = target->cy1;
+	lcd_ellipse_row( xc, yc, rx, ry, y-1, &lp, &rp );
+	lcd_ellipse_row( xc, yc, rx, ry, y, &l, &r );
+	for( ; y <= y1; y++ )
+	{
+		lcd_ellipse_row( xc, yc, rx, ry, y+1, &ln, &rn );
+		if( l <= r )
+		{
+			a = ((lp > ln) ? lp : ln) - 1;      // el borde llega hasta donde empiezan las filas vecinas
+			b = ((rp < rn) ? rp : rn) + 1;
+			if( a < l )
+				a = l;
+			if( b > r )
+				b = r;
+			if( lp > rp || ln > rn || a + 1 >= b )    // fila extrema o bordes que se tocan: se pinta entera
+				lcd_span( l, r, y, color );
+			else
+			{
+				lcd_span( l, a, y, color );
+				lcd_span( b, r, y, color );
+			}
+		}
+		lp = l; rp = r;
+		l = ln; r = rn;
+	}
+}
+
+void lcd_fill_ellipse( fix32 xc, fix32 yc, fix32 rx, fix32 ry, uint8 color )
+{
+	int32 y, y1, l, r;
+
+	y = FSUB( yc, ry ) >> LCD_FIX_Q;
+	y1 = FADD( yc, ry ) >> LCD_FIX_Q;
+	if( y < target->cy0 )
+		y = target->cy0;
+	if( y1 >= target->cy1 )
+		y1 = target->cy1 - 1;
+	for( ; y <= y1; y++ )
+	{
+		lcd_ellipse_row( xc, yc, rx, ry, y, &l, &r );
+		lcd_span( l, r, y, color );
+	}
+}
+
+void lcd_draw_circle( fix32 xc, fix32 yc, fix32 r, uint8 color )
+{
+	lcd_draw_ellipse( xc, yc, r, r, color );
+}
+
+void lcd_fill_circle( fix32 xc, fix32 yc, fix32 r, uint8 color )
+{
+	lcd_fill_ellipse( xc, yc, r, r, color );
+}
+
+/*
+** Para cada fila se cortan con su centro todas las aristas que la cruzan; al ser convexo basta con el mnimo y el mximo
+** Un pixel se pinta si su centro est en [xmin, xmax) (regla superior-izquierda: polgonos adyacentes no se solapan)
+*/
+void lcd_fill_polygon( const fix32 *xy, uint8 n, uint8 color )
+{
+	fix32 slope[LCD_POLYGON_VERTICES];
+	fix32 ymin, ymax, yr, x, xmin, xmax;
+	const fix32 *p, *q;
+	int32 y, y1;
+	uint8 i;
+
+	if( n < 3 || n > LCD_POLYGON_VERTICES )
+		return;
+	ymin = ymax = xy[1];
+	for( i=0; i<n; i++ )
+	{
+		p = xy + 2*i;
+		q = xy + 2*((i+1 == n) ? 0 : i+1);
+		slope[i] = (p[1] == q[1]) ? 0 : FDIV( FSUB(q[0],p[0]), FSUB(q[1],p[1]), 16 );
+		if( p[1] < ymin ) ymin = p[1];
+		if( p[1] > ymax ) ymax = p[1];
+	}
+	y = FSUB( FADD( ymin, LCD_FIX_HALF ), 1 ) >> LCD_FIX_Q;     // primera fila cuyo centro no queda por encima
+	y1 = FSUB( ymax, LCD_FIX_HALF ) >> LCD_FIX_Q;
+	if( y < target->cy0 )
+		y = target->cy0;
+	if( y1 >= target->cy1 )
+		y1 = target->cy1 - 1;
+	for( ; y <= y1; y++ )
+	{
+		yr = FADDI( LCD_FIX_HALF, y, LCD_FIX_Q );
+		xmin = MAX_FIX32;
+		xmax = MIN_FIX32;
+		for( i=0; i<n; i++ )
+		{
+			p = xy + 2*i;
+			q = xy + 2*((i+1 == n) ? 0 : i+1);
+			if( (p[1] <= yr && yr < q[1]) || (q[1] <= yr && yr < p[1]) )
+			{
+				x = p[0] + FMUL( slope[i], FSUB( yr, p[1] ), 16 );
+				if( x < xmin ) xmin = x;
+				if( x > xmax ) xmax = x;
+			}
+		}
+		if( xmin < xmax )
+			lcd_span( FSUB( FADD( xmin, LCD_FIX_HALF ), 1 ) >> LCD_FIX_Q, (FSUB( FADD( xmax, LCD_FIX_HALF ), 1 ) >> LCD_FIX_Q) - 1, y, color );
+	}
+}
+
+/*
+** Columnas [left, right] de la fila y cuyos centros quedan dentro de la elipse (left > right si no hay ninguna)
+*/
+static void lcd_ellipse_row( fix32 xc, fix32 yc, fix32 rx, fix32 ry, int32 y, int32 *left, int32 *right )
+{
+	fix32 v, w;
+
+	v = FSUB( FADDI( LCD_FIX_HALF, y, LCD_FIX_Q ), yc );
+	if( v < 0 )
+		v = -v;
+	if( ry <= 0 || v > ry )
+	{
+		*left = 1;
+		*right = 0;
+		return;
+	}
+	w = FDIVI( FMULI( rx, lcd_isqrt( FMULI( ry, ry ) - FMULI( v, v ) ) ), ry );    // semianchura en Q LCD_FIX_Q
+	*left = FSUB( FADD( FSUB( xc, w ), LCD_FIX_HALF ), 1 ) >> LCD_FIX_Q;
+	*right = FSUB( FADD( xc, w ), LCD_FIX_HALF ) >> LCD_FIX_Q;
+}
+
+/*
+** Raz cuadrada entera por el mtodo de los bits (sin divisiones)
+*/
+static uint32 lcd_isqrt( uint32 n )
+{
+	uint32 root, bit;
+
+	root = 0;
+	for( bit = 1 << 30; bit > n; bit >>= 2 );
+	for( ; bit; bit >>= 2 )
+	{
+		if( n >= root + bit )
+		{
+			n -= root + bit;
+			root = (root >> 1) + bit;
+		}
+		else
+			root >>= 1;
+	}
+	return root;
+}
+
+/*
+** Rellena un rectangulo con el color indicado, fila a fila, usando spans de palabras
+*/
+static void lcd_fill( uint16 x, uint16 y, uint16 xsize, uint16 ysize, uint8 color )
+{
+	uint8 *row;
+	uint32 pattern;
+	uint16 i;
+	rect_t r;
+
+	if( !lcd_clip_rect( x, y, xsize, ysize, &r ) )
+		return;
+	pattern = color * 0x11111111;
+	row = target->base + r.y0*target->stride;
+	for( i = r.y1 - r.y0; i; i-- )
+	{
+		lcd_fill_row( row, r.x0, r.x1 - r.x0, pattern );
+		row += target->stride;
+	}
+	lcd_mark( r.x0, r.y0, r.x1 - r.x0, r.y1 - r.y0 );
+}
+
+/*
+** Pinta los pixeles [x0, x1] de la fila y recortados por la superficie destino
+*/
+static void lcd_span( int32 x0, int32 x1, int32 y, uint8 color )
+{
+	if( y < target->cy0 || y >= target->cy1 )
+		return;
+	if( x0 < target->cx0 )
+		x0 = target->cx0;
+	if( x1 >= target->cx1 )
+		x1 = target->cx1 - 1;
+	if( x0 > x1 )
+		return;
+	lcd_fill_row( target->base + y*target->stride, x0, x1-x0+1, color * 0x11111111 );
+	lcd_mark( x0, y, x1-x0+1, 1 );
+}
+
+/*
+** Rellena n pixeles de una fila a partir de la columna x con el patron (color replicado 8 veces)
+** Solo los nibbles de los extremos se escriben con lectura-modificacion-escritura
+*/
+static void lcd_fill_row( uint8 *row, uint16 x, uint16 n, uint32 pattern )
+{
+	uint8 *p;
+	uint32 *w;
+
+	if( n && (x & 1) )
+	{
+		nibble_put( row, x++, pattern & 0xf );
+		n--;
+	}
+	p = row + (x>>1);
+	for( ; n >= 2 && ((uint32)p & 3); n -= 2 )
+		*p++ = pattern;
+	w = (uint32 *)p;
+	for( ; n >= 32; n -= 32 )
+	{
+		w[0] = pattern; w[1] = pattern; w[2] = pattern; w[3] = pattern;
+		w += 4;
+	}
+	for( ; n >= 8; n -= 8 )
+		*w++ = pattern;
+	p = (uint8 *)w;
+	for( ; n >= 2; n -= 2 )
+		*p++ = pattern;
+	if( n )
+		*p = (*p & 0x0f) | (pattern & 0xf0);
+}
+
+void lcd_putchar( uint16 x, uint16 y, uint8 color, char ch )
+{
+    lcd_putglyph( x, y, color, WHITE, ch, 1 );
 }
 
 void lcd_puts( uint16 x, uint16 y, uint8 color, char *s )
 {
-    while(*s != '\0'){
-    	lcd_putchar(x,y,color,*s++);
-    	x+=8;
-    }
+    lcd_text( x, y, color, s, 1 );
 }
 
 void lcd_putint( uint16 x, uint16 y, uint8 color, int32 i )
@@ -156,7 +1015,7 @@ void lcd_putint( uint16 x, uint16 y, uint8 color, int32 i )
 		i = i / 10;
 		*--p = '0' + c;
 	}
-	lcd_puts(x+8*num,y,color,p);
+	lcd_text_glyphs(x+8*num,y,color,p,1);    // las cifras cambian: no se guardan en la cache de cadenas
 }
 
 void lcd_puthex( uint16 x, uint16 y, uint8 color, uint32 i )
@@ -175,29 +1034,70 @@ void lcd_puthex( uint16 x, uint16 y, uint8 color, uint32 i )
 	            *--p = 'a' + c - 10;
 	        i = i >> 4;
 	    } while( i );
-	lcd_puts(x,y,color,p);
+	lcd_text_glyphs(x,y,color,p,1);
 }
 
-void lcd_putchar_x2( uint16 x, uint16 y, uint8 color, char ch )
+void lcd_field_init( lcd_field_t *field, uint16 x, uint16 y, uint8 color, uint8 width, char fill, uint8 scale )
 {
-	uint8 line, row;
-	uint8 *bitmap;
+    uint8 k;
 
-	bitmap = font + ch*16;
-	for( line=0; line<32; line++ )
-		for( row=0; row<16; row++ )
-			if( bitmap[line/2] & (0x80 >> row/2) )
-				lcd_putpixel( x+row, y+line, color );
-			else
-				lcd_putpixel( x+row, y+line, WHITE );
+    field->x = x;
+    field->y = y;
+    field->color = color;
+    field->width = (width > LCD_FIELD_DIGITS) ? LCD_FIELD_DIGITS : width;
+    field->fill = fill;
+    field->scale = scale;
+    for( k=0; k<LCD_FIELD_DIGITS; k++ )
+        field->shown[k] = '\0';
+}
+
+/*
+** Las cifras se obtienen por restas sucesivas de potencias de 10 (como mucho 9 por cifra); solo se divide
+** (mdulo) cuando el valor no cabe en el campo, en cuyo caso a los negativos se les reserva una celda para el signo
+*/
+void lcd_field_putint( lcd_field_t *field, int32 i )
+{
+    char buf[LCD_FIELD_DIGITS];
+    uint32 u, p;
+    uint8 k, first, digits;
+
+    u = (i < 0) ? -(uint32) i : (uint32) i;
+    digits = (i < 0 && field->width) ? field->width - 1 : field->width;
+    if( field_pow10[digits] && u >= field_pow10[digits] )
+        u %= field_pow10[digits];
+
+    first = field->width - 1;
+    for( k=0; k<field->width; k++ )
+    {
+        p = field_pow10[field->width-1-k];
+        for( buf[k] = '0'; u >= p; u -= p )
+            buf[k]++;
+        if( buf[k] != '0' && first == field->width - 1 )
+            first = k;
+    }
+    if( field->fill != '0' )
+        for( k=0; k<first; k++ )
+            if( buf[k] == '0' )
+                buf[k] = field->fill;
+    if( i < 0 )
+        buf[(field->fill == '0' || !first) ? 0 : first-1] = '-';
+
+    for( k=0; k<field->width; k++ )
+        if( buf[k] != field->shown[k] )
+        {
+            lcd_putglyph( field->x + k*8*field->scale, field->y, field->color, WHITE, buf[k], field->scale );
+            field->shown[k] = buf[k];
+        }
+}
+
+void lcd_putchar_x2( uint16 x, uint16 y, uint8 color, char ch )
+{
+	lcd_putglyph( x, y, color, WHITE, ch, 2 );
 }
 
 void lcd_puts_x2( uint16 x, uint16 y, uint8 color, char *s )
 {
-	 while(*s != '\0'){
-		lcd_putchar_x2(x,y,color,*s++);
-		x+=16;
-	}
+	lcd_text( x, y, color, s, 2 );
 }
 
 void lcd_putint_x2( uint16 x, uint16 y, uint8 color, int32 i )
@@ -216,7 +1116,7 @@ void lcd_putint_x2( uint16 x, uint16 y, uint8 color, int32 i )
 			i = i / 10;
 			*--p = '0' + c;
 		}
-		lcd_puts_x2(x+16*num,y,color,p);
+		lcd_text_glyphs(x+16*num,y,color,p,2);
 }
 
 void lcd_puthex_x2( uint16 x, uint16 y, uint8 color, uint32 i )
@@ -235,25 +1135,1212 @@ void lcd_puthex_x2( uint16 x, uint16 y, uint8 color, uint32 i )
 	            *--p = 'a' + c - 10;
 	        i = i >> 4;
 	    } while( i );
-	lcd_puts_x2(x,y,color,p);
+	lcd_text_glyphs(x,y,color,p,2);
 }
 
-void lcd_putWallpaper( uint8 *bmp )
+/*
+** Construye la tabla que expande los 8 bits de una fila de la fuente a 8 nibbles
+** El pixel de la izquierda (bit 7) ocupa el nibble alto del primer byte
+*/
+static void lcd_glyph_init( void )
 {
-    uint32 headerSize;
+    uint16 b, i;
+    uint32 m;
+
+    for( b=0; b<256; b++ )
+    {
+        for( m=0, i=0; i<8; i++ )
+            if( b & (0x80 >> i) )
+                m |= 0xf << (((i >> 1) << 3) + ((i & 1) ? 0 : 4));
+        glyph_mask[b] = m;
+    }
+    for( i=0; i<LCD_GLYPH_CACHE_X1; i++ )
+        glyph_x1[i].key = 0;
+    for( i=0; i<LCD_GLYPH_CACHE_X2; i++ )
+        glyph_x2[i].key = 0;
+    for( i=0; i<LCD_TEXT_RUNS; i++ )
+        text_runs[i].scale = 0;
+    text_pool_used = 0;
+}
 
-    uint16 x, ySrc, yDst;
-    uint16 offsetSrc, offsetDst;
+/*
+** Pinta un caracter de la fuente 8x16 a escala 1 o 2 con los colores indicados
+** El glifo se expande a 4b/px una sola vez y se guarda en una cache de correspondencia directa
+** indexada por caracter y colores; si x es multiplo de 8 cada fila se escribe con accesos a palabra,
+** en otro caso se copia con el blitter
+*/
+static void lcd_putglyph( uint16 x, uint16 y, uint8 color, uint8 bgcolor, uint8 ch, uint8 scale )
+{
+    uint8 *bitmap;
+    uint32 key, fg, bg, m;
+    uint32 *dst;
+    uint16 line, idx;
+    glyph_x1_t *g1;
+    glyph_x2_t *g2;
+    rect_t r;
+    boolean whole;
 
-    headerSize = bmp[10] + (bmp[11] << 8) + (bmp[12] << 16) + (bmp[13] << 24);
+    if( !lcd_clip_rect( x, y, 8*scale, 16*scale, &r ) )
+        return;
+    whole = r.x0 == x && r.y0 == y && r.x1 == x + 8*scale && r.y1 == y + 16*scale;
 
-    bmp = bmp + headerSize;
-    
-    for( ySrc=0, yDst=LCD_HEIGHT-1; ySrc<LCD_HEIGHT; ySrc++, yDst-- )                                                                       
+    key = (1 << 16) | (bgcolor << 12) | (color << 8) | ch;
+    fg = color * 0x11111111;
+    bg = bgcolor * 0x11111111;
+    bitmap = font + ch*16;
+
+    if( scale == 1 )
+    {
+        idx = (ch ^ (color << 2) ^ (bgcolor << 4)) & (LCD_GLYPH_CACHE_X1-1);
+        g1 = &glyph_x1[idx];
+        if( g1->key != key )
+        {
+            for( line=0; line<16; line++ )
+            {
+                m = glyph_mask[bitmap[line]];
+                g1->rows[line] = (fg & m) | (bg & ~m);
+            }
+            g1->key = key;
+        }
+        if( whole && !(x & 7) )
+        {
+            dst = (uint32 *)(target->base + y*target->stride + (x >> 1));
+            for( line=0; line<16; line++, dst += target->stride/4 )
+                *dst = g1->rows[line];
+        }
+        else
+            lcd_blit( target->base + r.y0*target->stride, target->stride, r.x0, (uint8 *)&g1->rows[r.y0-y], 4, r.x0-x, r.x1-r.x0, r.y1-r.y0, 0 );
+    }
+    else
     {
-        offsetDst = yDst*LCD_WIDTH/2;
-        offsetSrc = ySrc*LCD_WIDTH/2;
-        for( x=0; x<LCD_WIDTH/2; x++ )
-            lcd_buffer[offsetDst+x] = ~bmp[offsetSrc+x];
+        idx = (ch ^ (color << 2) ^ (bgcolor << 4)) & (LCD_GLYPH_CACHE_X2-1);
+        g2 = &glyph_x2[idx];
+        if( g2->key != key )
+        {
+            for( line=0; line<16; line++ )
+            {
+                m = glyph_mask[glyph_double[bitmap[line] >> 4]];
+                g2->rows[line][0] = (fg & m) | (bg & ~m);
+                m = glyph_mask[glyph_double[bitmap[line] & 0xf]];
+                g2->rows[line][1] = (fg & m) | (bg & ~m);
+            }
+            g2->key = key;
+        }
+        if( whole && !(x & 7) )
+        {
+            dst = (uint32 *)(target->base + y*target->stride + (x >> 1));
+            for( line=0; line<16; line++ )
+            {
+                dst[0] = g2->rows[line][0]; dst[1] = g2->rows[line][1];
+                dst += target->stride/4;
+                dst[0] = g2->rows[line][0]; dst[1] = g2->rows[line][1];
+                dst += target->stride/4;
+            }
+        }
+        else
+            for( line=r.y0; line<r.y1; line++ )
+                lcd_blit_row( target->base + line*target->stride, r.x0, (uint8 *)g2->rows[(line-y) >> 1], r.x0-x, r.x1-r.x0, 0 );
     }
+    lcd_mark( r.x0, r.y0, r.x1-r.x0, r.y1-r.y0 );
+}
+
+void lcd_putWallpaper( uint8 *bmp )
+{
+    lcd_putBmp( bmp, 0, 0, LCD_WIDTH, LCD_HEIGHT );
+}
+
+void lcd_putBmp( uint8 *bmp, uint16 x, uint16 y, uint16 xsize, uint16 ysize )
+{
+    uint32 headerSize;
+    int32 stride;
+    rect_t r;
+
+    if( !lcd_clip_rect( x, y, xsize, ysize, &r ) )
+        return;
+    headerSize = bmp[10] + (bmp[11] << 8) + (bmp[12] << 16) + (bmp[13] << 24);
+    stride = ((xsize*4 + 31) >> 5) << 2;    // las filas del BMP estan alineadas a 4 bytes
+
+    bmp = bmp + headerSize + (ysize-1-(r.y0-y))*stride;    // el BMP se almacena de abajo a arriba
+
+    lcd_blit( target->base + r.y0*target->stride, target->stride, r.x0, bmp, -stride, r.x0-x, r.x1-r.x0, r.y1-r.y0, 0xffffffff );
+    lcd_mark( r.x0, r.y0, r.x1-r.x0, r.y1-r.y0 );
+}
+
+lcd_bitmap_t *lcd_loadBitmap( uint8 *addr )
+{
+    lcd_bitmap_t *bmp = (lcd_bitmap_t *)addr;
+
+    if( ((uint32)addr & 3) || bmp->magic != LCD_BITMAP_MAGIC || (bmp->format != LCD_BITMAP_RAW && bmp->format != LCD_BITMAP_RLE) || (bmp->stride & 3) )
+        return NULL;
+    return bmp;
+}
+
+void lcd_putBitmap( lcd_bitmap_t *bmp, uint16 x, uint16 y )
+{
+    rect_t r;
+
+    if( !lcd_clip_rect( x, y, bmp->width, bmp->height, &r ) )
+        return;
+    lcd_unpack( target->base + r.y0*target->stride, target->stride, r.x0, bmp, r.x0-x, r.y0-y, r.x1-r.x0, r.y1-r.y0 );
+    lcd_mark( r.x0, r.y0, r.x1-r.x0, r.y1-r.y0 );
+}
+
+lcd_anim_t *lcd_loadAnim( uint8 *addr )
+{
+    lcd_anim_t *anim = (lcd_anim_t *)addr;
+
+    if( ((uint32)addr & 3) || anim->magic != LCD_ANIM_MAGIC || !anim->frames || (anim->stride & 3) )
+        return NULL;
+    return anim;
+}
+
+void lcd_anim_start( lcd_player_t *player, lcd_anim_t *anim, uint16 x, uint16 y )
+{
+    rect_t r;
+
+    player->anim = anim;
+    player->x = x;
+    player->y = y;
+    player->frame = 0;
+    player->delta = anim->data + anim->height*anim->stride;
+    if( !lcd_clip_rect( x, y, anim->width, anim->height, &r ) )
+        return;
+    lcd_blit( target->base + r.y0*target->stride, target->stride, r.x0, anim->data + (r.y0-y)*anim->stride, anim->stride, r.x0-x, r.x1-r.x0, r.y1-r.y0, 0 );
+    lcd_mark( r.x0, r.y0, r.x1-r.x0, r.y1-r.y0 );
+}
+
+/*
+** Cada span se recorta por separado; los que quedan fuera de la superficie solo se saltan
+*/
+void lcd_anim_step( lcd_player_t *player )
+{
+    lcd_anim_t *anim = player->anim;
+    const uint8 *p;
+    uint16 row, col, n;
+    rect_t r;
+
+    for( p = player->delta; (n = 2*p[3]); p += 4 + p[3] )
+    {
+        row = p[0] | (p[1] << 8);
+        col = 2*p[2];
+        if( col + n > anim->width )
+            n = anim->width - col;          // nibble de relleno de una anchura impar
+        if( !lcd_clip_rect( player->x + col, player->y + row, n, 1, &r ) )
+            continue;
+        lcd_blit_row( target->base + r.y0*target->stride, r.x0, p + 4, r.x0 - (player->x + col), r.x1-r.x0, 0 );
+        lcd_mark( r.x0, r.y0, r.x1-r.x0, 1 );
+    }
+    if( ++player->frame == anim->frames )
+    {
+        player->frame = 0;
+        player->delta = anim->data + anim->height*anim->stride;
+    }
+    else
+        player->delta = p + 4;
+}
+
+void lcd_putBitmapOrient( lcd_bitmap_t *bmp, uint16 x, uint16 y, uint8 orient )
+{
+    uint16 v;
+    rect_t r;
+
+    orient = orient_normalize( orient );
+    if( !lcd_clip_rect( x, y, orient_width( bmp, orient ), orient_height( bmp, orient ), &r ) )
+        return;
+    for( v=r.y0; v<r.y1; v++ )
+        lcd_blit_row_orient( target->base + v*target->stride, r.x0, r.x1-r.x0, bmp, NULL, orient, r.x0-x, v-y );
+    lcd_mark( r.x0, r.y0, r.x1-r.x0, r.y1-r.y0 );
+}
+
+/*
+** Vuelca en dst la ventana de xsize*ysize pixeles de un bitmap nativo, comprimido o no, que empieza en (sx,sy)
+*/
+static void lcd_unpack( uint8 *dst, int32 dstStride, uint16 dx, const lcd_bitmap_t *bmp, uint16 sx, uint16 sy, uint16 xsize, uint16 ysize )
+{
+    rle_t rle;
+
+    if( bmp->format == LCD_BITMAP_RAW )
+    {
+        lcd_blit( dst, dstStride, dx, bmp->data + sy*bmp->stride, bmp->stride, sx, xsize, ysize, 0 );
+        return;
+    }
+    rle.src = bmp->data;
+    rle.count = 0;
+    for( ; sy; sy-- )
+        lcd_rle_row( &rle, dst, dx, sx, 0, bmp->stride );
+    for( ; ysize; ysize--, dst += dstStride )
+        lcd_rle_row( &rle, dst, dx, sx, xsize, bmp->stride );
+}
+
+/*
+** Consume del flujo comprimido los bytes de una fila y escribe sus pixeles sx..sx+n-1 a partir de la columna dx
+** Si dx y sx tienen la misma paridad los bytes caen enteros en el destino: las repeticiones se rellenan por palabras
+*/
+static void lcd_rle_row( rle_t *rle, uint8 *dst, uint16 dx, uint16 sx, uint16 n, uint16 bytes )
+{
+    uint16 k, px, p0, p1, i;
+    uint8 c;
+
+    for( px=0; bytes; bytes -= k, px += 2*k )
+    {
+        if( !rle->count )
+        {
+            c = *rle->src++;
+            rle->run = (c & 0x80) != 0;
+            if( rle->run )
+            {
+                rle->count = (c & 0x7f) + 2;
+                rle->value = *rle->src++;
+            }
+            else
+                rle->count = c + 1;
+        }
+        k = (rle->count < bytes) ? rle->count : bytes;
+        rle->count -= k;
+        p0 = (px > sx) ? px : sx;                           // pixeles [p0, p1) del paquete que caen en la ventana
+        p1 = (px + 2*k < sx + n) ? px + 2*k : sx + n;
+
+        if( rle->run )
+        {
+            if( p0 >= p1 )
+                ;
+            else if( !((dx ^ sx) & 1) )
+                lcd_fill_row( dst, dx+p0-sx, p1-p0, rle->value * 0x01010101 );
+            else
+                for( i=p0; i<p1; i++ )
+                    nibble_put( dst, dx+i-sx, (i & 1) ? (rle->value & 0xf) : (rle->value >> 4) );
+        }
+        else
+        {
+            if( p0 >= p1 )
+                ;
+            else if( !((dx ^ sx) & 1) )
+            {
+                i = p0;
+                if( i & 1 )
+                {
+                    nibble_put( dst, dx+i-sx, rle->src[(i-px)>>1] & 0xf );
+                    i++;
+                }
+                for( ; i+1 < p1; i += 2 )
+                    dst[(dx+i-sx)>>1] = rle->src[(i-px)>>1];
+                if( i < p1 )
+                    nibble_put( dst, dx+i-sx, rle->src[(i-px)>>1] >> 4 );
+            }
+            else
+                for( i=p0; i<p1; i++ )
+                    nibble_put( dst, dx+i-sx, nibble_get( rle->src, i-px ) );
+            rle->src += k;
+        }
+    }
+}
+
+/*
+** Copia un rectangulo de xsize*ysize pixeles de 4b/px
+**   dst/src apuntan a la primera fila, dx/sx son la columna (en pixeles) dentro de ella
+**   dstStride/srcStride son la distancia en bytes entre filas (negativa para recorrer de abajo a arriba)
+**   xmask se aplica con XOR a cada palabra copiada (0xffffffff invierte los colores)
+*/
+static void lcd_blit( uint8 *dst, int32 dstStride, uint16 dx, const uint8 *src, int32 srcStride, uint16 sx, uint16 xsize, uint16 ysize, uint32 xmask )
+{
+    for( ; ysize; ysize-- )
+    {
+        lcd_blit_row( dst, dx, src, sx, xsize, xmask );
+        dst += dstStride;
+        src += srcStride;
+    }
+}
+
+/*
+** Copia n pixeles de una fila moviendo 8 pixeles por acceso a palabra
+**   Cabecera: pixel a pixel hasta que el destino queda alineado a palabra
+**   Cuerpo: si el origen tambien esta alineado copia en rafagas de 4 palabras (ldm/stm),
+**           si no, compone cada palabra con desplazamientos de byte y, si el origen
+**           empieza en el nibble bajo, con un desplazamiento adicional de 1 pixel
+**   Cola: pixel a pixel
+** Notas:
+**   En memoria little-endian el pixel par ocupa el nibble alto de cada byte
+**   En el caso desalineado puede leerse la palabra siguiente al final de la fila origen
+*/
+static void lcd_blit_row( uint8 *dst, uint16 dx, const uint8 *src, uint16 sx, uint16 n, uint32 xmask )
+{
+    uint32 *d;
+    const uint32 *s;
+    uint32 w0, w1, w2, w3, w;
+    uint32 addr, shr, shl;
+    uint16 nw;
+
+    while( n && ((dx & 1) || ((uint32)(dst + (dx>>1)) & 3)) )
+    {
+        nibble_put( dst, dx++, nibble_get( src, sx++ ) ^ (xmask & 0xf) );
+        n--;
+    }
+
+    nw = n >> 3;
+    if( nw )
+    {
+        d = (uint32 *)(dst + (dx>>1));
+        addr = (uint32)(src + (sx>>1));
+        s = (const uint32 *)(addr & ~3);
+        shr = (addr & 3) << 3;
+        shl = 32 - shr;
+        dx += nw << 3;
+        sx += nw << 3;
+
+        if( !shr && !(sx & 1) )
+        {
+            for( ; nw >= 4; nw -= 4 )
+            {
+                w0 = s[0]; w1 = s[1]; w2 = s[2]; w3 = s[3];
+                s += 4;
+                d[0] = w0 ^ xmask; d[1] = w1 ^ xmask; d[2] = w2 ^ xmask; d[3] = w3 ^ xmask;
+                d += 4;
+            }
+            for( ; nw; nw-- )
+                *d++ = *s++ ^ xmask;
+        }
+        else
+        {
+            w0 = *s++;
+            for( ; nw; nw-- )
+            {
+                w1 = *s++;
+                w = shr ? (w0 >> shr) | (w1 << shl) : w0;
+                if( sx & 1 )
+                {
+                    w0 = shr ? (w1 >> shr) : w1;    // el 5o byte aporta el ultimo pixel
+                    w = ((w & 0x0f0f0f0f) << 4) | ((w >> 12) & 0x000f0f0f) | ((w0 & 0xf0) << 20);
+                }
+                *d++ = w ^ xmask;
+                w0 = w1;
+            }
+        }
+    }
+
+    for( n &= 7; n; n-- )
+        nibble_put( dst, dx++, nibble_get( src, sx++ ) ^ (xmask & 0xf) );
+}
+
+/*
+** Devuelve los 8 pixeles de una fila que empiezan en la columna sx, en el orden de una palabra del buffer
+*/
+static inline uint32 blit_fetch( const uint8 *src, uint16 sx )
+{
+    const uint32 *s;
+    uint32 addr, shr, w, w1;
+
+    addr = (uint32)(src + (sx>>1));
+    s = (const uint32 *)(addr & ~3);
+    shr = (addr & 3) << 3;
+    w = s[0];
+    w1 = s[1];
+    if( shr )
+    {
+        w = (w >> shr) | (w1 << (32-shr));
+        w1 >>= shr;
+    }
+    if( sx & 1 )
+        w = ((w & 0x0f0f0f0f) << 4) | ((w >> 12) & 0x000f0f0f) | ((w1 & 0xf0) << 20);
+    return w;
+}
+
+/*
+** Copia n pixeles de una fila solo donde la mascara (misma geometria que el origen) vale 0xf
+*/
+static void lcd_blit_row_masked( uint8 *dst, uint16 dx, const uint8 *src, const uint8 *mask, uint16 sx, uint16 n )
+{
+    uint32 *d;
+    uint32 m;
+
+    while( n && ((dx & 1) || ((uint32)(dst + (dx>>1)) & 3)) )
+    {
+        if( nibble_get( mask, sx ) )
+            nibble_put( dst, dx, nibble_get( src, sx ) );
+        dx++; sx++; n--;
+    }
+    for( d = (uint32 *)(dst + (dx>>1)); n >= 8; n -= 8, dx += 8, sx += 8, d++ )
+    {
+        m = blit_fetch( mask, sx );
+        if( m == 0xffffffff )
+            *d = blit_fetch( src, sx );
+        else if( m )
+            *d = (*d & ~m) | (blit_fetch( src, sx ) & m);
+    }
+    for( ; n; n--, dx++, sx++ )
+        if( nibble_get( mask, sx ) )
+            nibble_put( dst, dx, nibble_get( src, sx ) );
+}
+
+/*
+** Invierte el orden de los 8 pixeles de una palabra
+*/
+static inline uint32 blit_reverse( uint32 w )
+{
+    w = (w >> 24) | ((w >> 8) & 0xff00) | ((w << 8) & 0xff0000) | (w << 24);
+    return ((w >> 4) & 0x0f0f0f0f) | ((w & 0x0f0f0f0f) << 4);
+}
+
+/*
+** Una orientacin es un giro en sentido horario (LCD_ROT_*) seguido opcionalmente de un espejo horizontal;
+** el espejo vertical equivale a girar 180 grados ms y cambiar el horizontal
+*/
+static inline uint8 orient_normalize( uint8 orient )
+{
+    if( orient & LCD_MIRROR_V )
+        orient = ((orient + 2) & 3) | (~orient & LCD_MIRROR_H);
+    return orient & (3 | LCD_MIRROR_H);
+}
+
+static inline uint16 orient_width( const lcd_bitmap_t *bmp, uint8 orient )
+{
+    return (orient & 1) ? bmp->height : bmp->width;
+}
+
+static inline uint16 orient_height( const lcd_bitmap_t *bmp, uint8 orient )
+{
+    return (orient & 1) ? bmp->width : bmp->height;
+}
+
+/*
+** Pinta en dst, a partir de la columna dx, los n pixeles (u..u+n-1, v) del bitmap ya orientado
+** Cada orientacin recorre el origen a lo largo de una fila (hacia delante: blit por palabras,
+** hacia atrs: palabras con los pixeles invertidos) o de una columna (avanzando stride bytes por pixel)
+** Si mask no es NULL solo se copian los pixeles opacos
+*/
+static void lcd_blit_row_orient( uint8 *dst, uint16 dx, uint16 n, const lcd_bitmap_t *bmp, const uint8 *mask, uint8 orient, uint16 u, uint16 v )
+{
+    const uint8 *row, *mrow, *p, *m;
+    uint32 *d;
+    uint32 w, wm;
+    int32 up, sx, sy, dir, step;
+    uint8 shift;
+
+    up = (orient & LCD_MIRROR_H) ? orient_width( bmp, orient ) - 1 - u : u;
+    dir = (orient & LCD_MIRROR_H) ? -1 : 1;
+
+    switch( orient & 3 )
+    {
+        case LCD_ROT_0:   sx = up;                  sy = v;                    step = dir;  break;
+        case LCD_ROT_90:  sx = v;                   sy = bmp->height - 1 - up; step = -dir; break;
+        case LCD_ROT_180: sx = bmp->width - 1 - up; sy = bmp->height - 1 - v;  step = -dir; break;
+        default:          sx = bmp->width - 1 - v;  sy = up;                   step = dir;  break;
+    }
+
+    row = bmp->data + sy*bmp->stride;
+    mrow = mask ? mask + sy*bmp->stride : NULL;
+
+    if( !(orient & 1) && step > 0 )
+    {
+        if( mrow )
+            lcd_blit_row_masked( dst, dx, row, mrow, sx, n );
+        else
+            lcd_blit_row( dst, dx, row, sx, n, 0 );
+    }
+    else if( !(orient & 1) )
+    {
+        while( n && ((dx & 1) || ((uint32)(dst + (dx>>1)) & 3)) )
+        {
+            if( !mrow || nibble_get( mrow, sx ) )
+                nibble_put( dst, dx, nibble_get( row, sx ) );
+            dx++; sx--; n--;
+        }
+        for( d = (uint32 *)(dst + (dx>>1)); n >= 8; n -= 8, dx += 8, sx -= 8, d++ )
+        {
+            wm = mrow ? blit_reverse( blit_fetch( mrow, sx-7 ) ) : 0xffffffff;
+            if( wm == 0xffffffff )
+                *d = blit_reverse( blit_fetch( row, sx-7 ) );
+            else if( wm )
+                *d = (*d & ~wm) | (blit_reverse( blit_fetch( row, sx-7 ) ) & wm);
+        }
+        for( ; n; n--, dx++, sx-- )
+            if( !mrow || nibble_get( mrow, sx ) )
+                nibble_put( dst, dx, nibble_get( row, sx ) );
+    }
+    else
+    {
+        p = row + (sx >> 1);
+        m = mrow ? mrow + (sx >> 1) : NULL;
+        shift = (sx & 1) ? 0 : 4;
+        step *= bmp->stride;
+        for( ; n; n--, dx++, p += step )
+        {
+            if( m )
+            {
+                w = *m;
+                m += step;
+                if( !((w >> shift) & 0xf) )
+                    continue;
+            }
+            nibble_put( dst, dx, (*p >> shift) & 0xf );
+        }
+    }
+}
+
+/*
+** Sprites con transparencia compuestos por capas
+*/
+
+void lcd_sprites_init( lcd_bitmap_t *background )
+{
+    uint8 i;
+
+    for( i=0; i<LCD_SPRITES; i++ )
+        layers[i].used = FALSE;
+    for( i=0; i<LCD_SPRITE_MASKS; i++ )
+        layer_masks[i].bmp = NULL;
+    layer_count = 0;
+    mask_used = 0;
+    damage_count = 0;
+    lcd_setBackground( background );
+    lcd_restoreWindow( 0, 0, LCD_WIDTH, LCD_HEIGHT );
+}
+
+uint8 lcd_sprite_add( lcd_bitmap_t *bmp, uint16 x, uint16 y, uint8 z, uint8 key )
+{
+    uint8 id, i;
+
+    if( bmp->format != LCD_BITMAP_RAW )
+        return LCD_SPRITE_NONE;
+    for( id=0; id<LCD_SPRITES && layers[id].used; id++ );
+    if( id == LCD_SPRITES )
+        return LCD_SPRITE_NONE;
+
+    layers[id].used = TRUE;
+    layers[id].visible = TRUE;
+    layers[id].bmp = bmp;
+    layers[id].key = key;
+    layers[id].mask = lcd_sprite_mask( bmp, key );
+    layers[id].x = x;
+    layers[id].y = y;
+    layers[id].z = z;
+    layers[id].orient = LCD_ROT_0;
+
+    for( i=layer_count; i && layers[layer_order[i-1]].z > z; i-- )
+        layer_order[i] = layer_order[i-1];
+    layer_order[i] = id;
+    layer_count++;
+
+    lcd_sprite_damage( id );
+    return id;
+}
+
+void lcd_sprite_remove( uint8 id )
+{
+    uint8 i;
+
+    lcd_sprite_damage( id );
+    layers[id].used = FALSE;
+    for( i=0; layer_order[i] != id; i++ );
+    for( layer_count--; i<layer_count; i++ )
+        layer_order[i] = layer_order[i+1];
+}
+
+void lcd_sprite_move( uint8 id, uint16 x, uint16 y )
+{
+    if( layers[id].x == x && layers[id].y == y )
+        return;
+    lcd_sprite_damage( id );
+    layers[id].x = x;
+    layers[id].y = y;
+    lcd_sprite_damage( id );
+}
+
+void lcd_sprite_set( uint8 id, lcd_bitmap_t *bmp )
+{
+    if( layers[id].bmp == bmp || bmp->format != LCD_BITMAP_RAW )
+        return;
+    lcd_sprite_damage( id );
+    layers[id].bmp = bmp;
+    layers[id].mask = lcd_sprite_mask( bmp, layers[id].key );
+    lcd_sprite_damage( id );
+}
+
+void lcd_sprite_orient( uint8 id, uint8 orient )
+{
+    orient = orient_normalize( orient );
+    if( layers[id].orient == orient )
+        return;
+    lcd_sprite_damage( id );
+    layers[id].orient = orient;
+    lcd_sprite_damage( id );
+}
+
+void lcd_sprite_show( uint8 id, boolean visible )
+{
+    if( layers[id].visible == visible )
+        return;
+    if( visible )
+    {
+        layers[id].visible = TRUE;
+        lcd_sprite_damage( id );
+    }
+    else
+    {
+        lcd_sprite_damage( id );
+        layers[id].visible = FALSE;
+    }
+}
+
+/*
+** Recompone solo las zonas daadas: restaura el fondo y pinta encima, en orden de z,
+** la parte de cada sprite visible que cae dentro de la zona
+*/
+void lcd_sprites_render( void )
+{
+    rect_t *d;
+    layer_t *l;
+    uint16 x0, y0, x1, y1, y, w, h;
+    uint8 i, j;
+
+    for( i=0; i<damage_count; i++ )
+    {
+        d = &damage[i];
+        lcd_restoreWindow( d->x0, d->y0, d->x1-d->x0, d->y1-d->y0 );
+
+        for( j=0; j<layer_count; j++ )
+        {
+            l = &layers[layer_order[j]];
+            if( !l->visible )
+                continue;
+            x0 = (l->x > d->x0) ? l->x : d->x0;
+            y0 = (l->y > d->y0) ? l->y : d->y0;
+            w = orient_width( l->bmp, l->orient );
+            h = orient_height( l->bmp, l->orient );
+            x1 = (l->x + w < d->x1) ? l->x + w : d->x1;
+            y1 = (l->y + h < d->y1) ? l->y + h : d->y1;
+            if( x0 >= x1 || y0 >= y1 )
+                continue;
+            for( y=y0; y<y1; y++ )
+                lcd_blit_row_orient( lcd_back + y*lcd_stride, x0, x1-x0, l->bmp, l->mask, l->orient, x0 - l->x, y - l->y );
+        }
+        lcd_dirty( d->x0, d->y0, d->x1-d->x0, d->y1-d->y0 );
+    }
+    damage_count = 0;
+}
+
+/*
+** Devuelve la mascara del bitmap para el color transparente indicado, calculandola la primera vez
+** Si no queda espacio o no hay color transparente el sprite se pinta opaco
+*/
+static uint8 *lcd_sprite_mask( lcd_bitmap_t *bmp, uint8 key )
+{
+    uint8 i;
+    uint16 x, y;
+    uint32 size;
+    uint8 *mask;
+
+    if( key == LCD_NO_KEY )
+        return NULL;
+    for( i=0; i<LCD_SPRITE_MASKS && layer_masks[i].bmp; i++ )
+        if( layer_masks[i].bmp == bmp && layer_masks[i].key == key )
+            return layer_masks[i].mask;
+    size = bmp->stride * bmp->height;
+    if( i == LCD_SPRITE_MASKS || mask_used + size > LCD_SPRITE_MASK_POOL )
+        return NULL;
+
+    mask = mask_pool + mask_used;
+    mask_used += size;
+    for( y=0; y<bmp->height; y++ )
+        for( x=0; x<bmp->stride*2; x++ )
+            nibble_put( mask + y*bmp->stride, x, (x < bmp->width && nibble_get( bmp->data + y*bmp->stride, x ) != key) ? 0xf : 0 );
+
+    layer_masks[i].bmp = bmp;
+    layer_masks[i].key = key;
+    layer_masks[i].mask = mask;
+    return mask;
+}
+
+static void lcd_sprite_damage( uint8 id )
+{
+    if( layers[id].visible )
+        lcd_damage( layers[id].x, layers[id].y, orient_width( layers[id].bmp, layers[id].orient ), orient_height( layers[id].bmp, layers[id].orient ) );
+}
+
+/*
+** Aade un rectangulo a las zonas daadas, fusionandolo con la primera con la que solape
+** Si no quedan entradas libres lo fusiona con la primera zona
+*/
+static void lcd_damage( uint16 x, uint16 y, uint16 xsize, uint16 ysize )
+{
+    rect_t r;
+    rect_t *d;
+    uint8 i;
+
+    if( x >= LCD_WIDTH || y >= LCD_HEIGHT || !xsize || !ysize )
+        return;
+    r.x0 = x;
+    r.y0 = y;
+    r.x1 = (x + xsize > LCD_WIDTH) ? LCD_WIDTH : x + xsize;
+    r.y1 = (y + ysize > LCD_HEIGHT) ? LCD_HEIGHT : y + ysize;
+
+    for( i=0; i<damage_count; i++ )
+        if( r.x0 <= damage[i].x1 && damage[i].x0 <= r.x1 && r.y0 <= damage[i].y1 && damage[i].y0 <= r.y1 )
+            break;
+    if( i == damage_count )
+    {
+        if( damage_count < LCD_SPRITE_DAMAGE )
+        {
+            damage[damage_count++] = r;
+            return;
+        }
+        i = 0;
+    }
+    d = &damage[i];
+    if( r.x0 < d->x0 ) d->x0 = r.x0;
+    if( r.y0 < d->y0 ) d->y0 = r.y0;
+    if( r.x1 > d->x1 ) d->x1 = r.x1;
+    if( r.y1 > d->y1 ) d->y1 = r.y1;
+}
+
+/*
+** Reserva la siguiente orden de la lista y le asigna la zona indicada; devuelve NULL si la lista est llena
+*/
+static dl_cmd_t *lcd_dl_add( uint8 type, uint16 x, uint16 y, uint16 xsize, uint16 ysize )
+{
+    dl_cmd_t *c;
+
+    if( dl_count == LCD_DL_COMMANDS )
+        return NULL;
+    c = &dl[dl_count++];
+    c->type = type;
+    c->x = x;
+    c->y = y;
+    c->r.x0 = x;
+    c->r.y0 = y;
+    c->r.x1 = x + xsize;
+    c->r.y1 = y + ysize;
+    c->data = NULL;
+    return c;
+}
+
+void lcd_dl_draw_box( uint16 xleft, uint16 yup, uint16 xright, uint16 ydown, uint8 color, uint16 width )
+{
+    dl_cmd_t *c;
+
+    if( (c = lcd_dl_add( DL_BOX, xleft, yup, xright-xleft+width, ydown-yup+width+1 )) )
+    {
+        c->color = color;
+        c->arg = width;
+    }
+}
+
+void lcd_dl_fill_box( uint16 xleft, uint16 yup, uint16 xright, uint16 ydown, uint8 color )
+{
+    dl_cmd_t *c;
+
+    if( (c = lcd_dl_add( DL_FILL, xleft, yup, xright-xleft+1, ydown-yup+1 )) )
+        c->color = color;
+}
+
+/*
+** Copia la cadena en dl_text (terminada en '\0') y aade la orden que la pinta
+*/
+static void lcd_dl_text( uint16 x, uint16 y, uint8 color, const char *s, uint8 scale )
+{
+    dl_cmd_t *c;
+    uint16 n;
+
+    for( n=0; s[n]; n++ );
+    if( dl_text_used + n + 1 > LCD_DL_TEXT || !(c = lcd_dl_add( DL_TEXT, x, y, 8*scale*n, 16*scale )) )
+        return;
+    c->color = color;
+    c->arg = scale;
+    c->data = dl_text + dl_text_used;
+    for( n++; n; n-- )
+        dl_text[dl_text_used++] = *s++;
+}
+
+void lcd_dl_puts( uint16 x, uint16 y, uint8 color, char *s )
+{
+    lcd_dl_text( x, y, color, s, 1 );
+}
+
+void lcd_dl_puts_x2( uint16 x, uint16 y, uint8 color, char *s )
+{
+    lcd_dl_text( x, y, color, s, 2 );
+}
+
+void lcd_dl_puthex( uint16 x, uint16 y, uint8 color, uint32 i )
+{
+    char buf[8 + 1];
+    char *p = buf + 8;
+    uint8 c;
+
+    *p = '\0';
+    do {
+        c = i & 0xf;
+        *--p = (c < 10) ? '0' + c : 'a' + c - 10;
+        i = i >> 4;
+    } while( i );
+    lcd_dl_text( x, y, color, p, 1 );
+}
+
+void lcd_dl_putBitmap( lcd_bitmap_t *bmp, uint16 x, uint16 y, uint8 orient )
+{
+    dl_cmd_t *c;
+
+    orient = orient_normalize( orient );
+    if( (c = lcd_dl_add( DL_BITMAP, x, y, orient_width( bmp, orient ), orient_height( bmp, orient ) )) )
+    {
+        c->color = orient;
+        c->data = bmp;
+    }
+}
+
+/*
+** Dos rdenes son iguales si pintan lo mismo en el mismo sitio (las cadenas se comparan por contenido)
+*/
+static boolean lcd_dl_same( const dl_cmd_t *a, const dl_cmd_t *b )
+{
+    const char *s, *t;
+
+    if( a->type != b->type || a->color != b->color || a->x != b->x || a->y != b->y || a->r.x1 != b->r.x1 || a->r.y1 != b->r.y1 )
+        return FALSE;
+    switch( a->type )
+    {
+        case DL_BOX:
+            return a->arg == b->arg;
+        case DL_TEXT:
+            if( a->arg != b->arg )
+                return FALSE;
+            for( s = a->data, t = b->data; *s && *s == *t; s++, t++ );
+            return *s == *t;
+        case DL_BITMAP:
+            return a->data == b->data;
+        default:
+            return TRUE;
+    }
+}
+
+/*
+** Una orden se descarta si una posterior es igual o es opaca (todas salvo la caja) y cubre toda su zona:
+** como todas las primitivas escriben sus pixeles sin leer los de destino, el resultado final no cambia
+*/
+void lcd_dl_render( void )
+{
+    dl_cmd_t *c, *d;
+    uint8 i, j;
+
+    for( i=0; i<dl_count; i++ )
+    {
+        c = &dl[i];
+        for( j=i+1; j<dl_count; j++ )
+        {
+            d = &dl[j];
+            if( lcd_dl_same( c, d ) )
+                break;
+            if( d->type != DL_BOX && d->r.x0 <= c->r.x0 && d->r.y0 <= c->r.y0 && c->r.x1 <= d->r.x1 && c->r.y1 <= d->r.y1 )
+                break;
+        }
+        if( j < dl_count )
+            continue;
+        switch( c->type )
+        {
+            case DL_BOX:
+                lcd_draw_box( c->x, c->y, c->r.x1 - c->arg, c->r.y1 - c->arg - 1, c->color, c->arg );
+                break;
+            case DL_FILL:
+                lcd_fill( c->x, c->y, c->r.x1 - c->x, c->r.y1 - c->y, c->color );
+                break;
+            case DL_TEXT:
+                if( c->arg == 1 )
+                    lcd_puts( c->x, c->y, c->color, c->data );
+                else
+                    lcd_puts_x2( c->x, c->y, c->color, c->data );
+                break;
+            case DL_BITMAP:
+                if( c->color == LCD_ROT_0 )
+                    lcd_putBitmap( c->data, c->x, c->y );
+                else
+                    lcd_putBitmapOrient( c->data, c->x, c->y, c->color );
+                break;
+        }
+    }
+    dl_count = 0;
+    dl_text_used = 0;
+}
+
+/*
+** Pinta una cadena con fondo blanco; si cabe en la cache de cadenas se pinta con un solo blit
+** del bitmap guardado en la ltima llamada con el mismo texto, color y escala (o que se crea ahora)
+*/
+static void lcd_text( uint16 x, uint16 y, uint8 color, const char *s, uint8 scale )
+{
+    lcd_surface_t surface;
+    text_run_t *run;
+    const char *a, *b;
+    uint16 n, i;
+
+    for( n=0; s[n] && n<=LCD_TEXT_LEN; n++ );
+    if( n < 2 || n > LCD_TEXT_LEN || 64*scale*scale*n > LCD_TEXT_CACHE )
+    {
+        lcd_text_glyphs( x, y, color, s, scale );
+        return;
+    }
+    for( i=0, run=NULL; i<LCD_TEXT_RUNS && !run; i++ )
+    {
+        if( text_runs[i].scale != scale || text_runs[i].color != color )
+            continue;
+        for( a = text_runs[i].text, b = s; *a && *a == *b; a++, b++ );
+        if( *a == *b )
+            run = &text_runs[i];
+    }
+    if( !run )
+        run = lcd_text_add( s, n, color, scale );
+    run->used = ++text_clock;
+    lcd_surface_init( &surface, text_pool + run->offset, 8*scale*n, 16*scale, 4*scale*n );
+    lcd_putSurface( &surface, x, y );
+}
+
+/*
+** Pinta la cadena caracter a caracter (con la cache de glifos)
+*/
+static void lcd_text_glyphs( uint16 x, uint16 y, uint8 color, const char *s, uint8 scale )
+{
+    for( ; *s; s++, x += 8*scale )
+        lcd_putglyph( x, y, color, WHITE, *s, scale );
+}
+
+/*
+** Guarda en la cache la cadena (de n caracteres) pintada sobre una superficie en text_pool
+** desalojando las menos usadas hasta que haya una entrada libre y espacio suficiente
+*/
+static text_run_t *lcd_text_add( const char *s, uint16 n, uint8 color, uint8 scale )
+{
+    lcd_surface_t surface, *old;
+    text_run_t *run;
+    uint32 size;
+    uint16 i;
+
+    size = 64*scale*scale*n;
+    for( ;; )
+    {
+        for( i=0; i<LCD_TEXT_RUNS && text_runs[i].scale; i++ );
+        if( i < LCD_TEXT_RUNS && text_pool_used + size <= LCD_TEXT_CACHE )
+            break;
+        lcd_text_evict();
+    }
+    run = &text_runs[i];
+    for( i=0; i<=n; i++ )
+        run->text[i] = s[i];
+    run->color = color;
+    run->scale = scale;
+    run->offset = text_pool_used;
+    run->size = size;
+    text_pool_used += size;
+
+    lcd_surface_init( &surface, text_pool + run->offset, 8*scale*n, 16*scale, 4*scale*n );
+    old = target;
+    target = &surface;
+    lcd_text_glyphs( 0, 0, color, s, scale );
+    target = old;
+    return run;
+}
+
+/*
+** Libera la entrada usada hace ms tiempo y compacta text_pool para que el espacio libre quede al final
+*/
+static void lcd_text_evict( void )
+{
+    text_run_t *lru;
+    uint32 *dst, *src, *end;
+    uint16 i;
+
+    for( lru=NULL, i=0; i<LCD_TEXT_RUNS; i++ )
+        if( text_runs[i].scale && (!lru || text_runs[i].used - lru->used > 0x80000000) )
+            lru = &text_runs[i];
+    if( !lru )
+        return;
+    lru->scale = 0;
+    dst = (uint32 *)(text_pool + lru->offset);
+    src = (uint32 *)(text_pool + lru->offset + lru->size);
+    end = (uint32 *)(text_pool + text_pool_used);
+    while( src < end )
+        *dst++ = *src++;
+    for( i=0; i<LCD_TEXT_RUNS; i++ )
+        if( text_runs[i].scale && text_runs[i].offset > lru->offset )
+            text_runs[i].offset -= lru->size;
+    text_pool_used -= lru->size;
+}
+
+/*
+** La consola usa una pantalla virtual de doble altura y cada lnea n se pinta en la fila de texto n % LCD_CONSOLE_ROWS
+** de sus dos mitades; as la ventana que empieza en la fila de la lnea ms antigua siempre es contigua
+** y desplazar el texto es solo cambiar pan_y
+*/
+boolean lcd_console_init( uint8 color )
+{
+    uint16 i, j;
+
+    if( !lcd_virtual( LCD_WIDTH, 2*LCD_HEIGHT ) )
+        return FALSE;
+    con_active = TRUE;
+    con_color = color;
+    for( i=0; i<LCD_CONSOLE_HISTORY; i++ )
+        for( j=0; j<LCD_CONSOLE_COLS; j++ )
+            con_text[i][j] = ' ';
+    lcd_console_clear();
+    return TRUE;
+}
+
+void lcd_console_clear( void )
+{
+    lcd_surface_t *old;
+
+    if( !con_active )
+        return;
+    con_line = 0;
+    con_col = 0;
+    con_back = 0;
+    for( ; con_col<LCD_CONSOLE_COLS; con_col++ )
+        con_text[0][con_col] = ' ';
+    con_col = 0;
+    old = target;
+    target = &screen;
+    lcd_clear();
+    target = old;
+    lcd_console_show();
+}
+
+void lcd_console_putchar( char ch )
+{
+    if( !con_active )
+        return;
+    if( con_back )
+        lcd_console_scrollback( 0 );
+    switch( ch )
+    {
+        case '\n':
+            lcd_console_newline();
+            break;
+        case '\r':
+            con_col = 0;
+            break;
+        case '\b':
+            if( con_col )
+                lcd_console_glyph( --con_col, con_line, ' ' );
+            break;
+        case '\t':
+            do
+                lcd_console_glyph( con_col++, con_line, ' ' );
+            while( (con_col & 7) && con_col < LCD_CONSOLE_COLS );
+            break;
+        default:
+            lcd_console_glyph( con_col++, con_line, ch );
+            break;
+    }
+    if( con_col == LCD_CONSOLE_COLS )
+        lcd_console_newline();
+}
+
+void lcd_console_puts( char *s )
+{
+    while( *s )
+        lcd_console_putchar( *s++ );
+}
+
+void lcd_console_putint( int32 i )
+{
+    char buf[11 + 1];
+    char *p = buf + 11;
+    uint32 u;
+
+    *p = '\0';
+    u = (i < 0) ? -i : i;
+    do {
+        *--p = '0' + u % 10;
+        u /= 10;
+    } while( u );
+    if( i < 0 )
+        *--p = '-';
+    lcd_console_puts( p );
+}
+
+void lcd_console_puthex( uint32 i )
+{
+    char buf[8 + 1];
+    char *p = buf + 8;
+    uint8 c;
+
+    *p = '\0';
+    do {
+        c = i & 0xf;
+        *--p = (c < 10) ? '0' + c : 'a' + c - 10;
+        i = i >> 4;
+    } while( i );
+    lcd_console_puts( p );
+}
+
+/*
+** Repinta las filas visibles con las lneas del anillo desplazadas lines posiciones hacia atrs
+*/
+void lcd_console_scrollback( uint16 lines )
+{
+    uint32 first, n;
+    uint16 max;
+    uint8 col;
+
+    if( !con_active )
+        return;
+    first = (con_line >= LCD_CONSOLE_ROWS) ? con_line - LCD_CONSOLE_ROWS + 1 : 0;
+    max = (first < LCD_CONSOLE_HISTORY - LCD_CONSOLE_ROWS) ? first : LCD_CONSOLE_HISTORY - LCD_CONSOLE_ROWS;
+    if( lines > max )
+        lines = max;
+    if( lines == con_back )
+        return;
+    con_back = lines;
+    for( n = first; n <= con_line; n++ )
+        for( col=0; col<LCD_CONSOLE_COLS; col++ )
+            lcd_console_glyph( col, n, con_text[(n - lines) % LCD_CONSOLE_HISTORY][col] );
+}
+
+/*
+** Pinta un caracter en las dos copias de la fila de la lnea indicada; el anillo de texto guarda
+** el de la lnea - con_back, que es la que ocupa esa fila mientras se mira hacia atrs
+*/
+static void lcd_console_glyph( uint8 col, uint32 line, char ch )
+{
+    lcd_surface_t *old;
+    uint16 y;
+
+    if( !con_back )
+        con_text[line % LCD_CONSOLE_HISTORY][col] = ch;
+    y = (line % LCD_CONSOLE_ROWS) * 16;
+    old = target;
+    target = &screen;
+    lcd_putglyph( 8*col, y, con_color, WHITE, ch, 1 );
+    lcd_putglyph( 8*col, y + LCD_HEIGHT, con_color, WHITE, ch, 1 );
+    target = old;
+}
+
+/*
+** Borra la nueva lnea (texto y sus dos copias en pantalla) y sube el texto una fila moviendo la ventana
+*/
+static void lcd_console_newline( void )
+{
+    lcd_surface_t *old;
+    uint16 y;
+    uint8 col;
+
+    con_line++;
+    con_col = 0;
+    for( col=0; col<LCD_CONSOLE_COLS; col++ )
+        con_text[con_line % LCD_CONSOLE_HISTORY][col] = ' ';
+    y = (con_line % LCD_CONSOLE_ROWS) * 16;
+    old = target;
+    target = &screen;
+    lcd_fill( 0, y, LCD_WIDTH, 16, WHITE );
+    lcd_fill( 0, y + LCD_HEIGHT, LCD_WIDTH, 16, WHITE );
+    target = old;
+    lcd_console_show();
+}
+
+/*
+** Muestra la ventana cuya primera fila es la de la lnea ms antigua visible
+** No espera al final del frame para no frenar la salida: como mucho se ve un frame a medio desplazar
+*/
+static void lcd_console_show( void )
+{
+    pan_y = (con_line >= LCD_CONSOLE_ROWS) ? ((con_line + 1) % LCD_CONSOLE_ROWS) * 16 : 0;
+    lcd_set_address( lcd_front );
 }
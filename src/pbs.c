@@ -1,13 +1,24 @@
 #include <s3c44b0x.h>
 #include <s3cev40.h>
+#include <system.h>
 #include <pbs.h>
 #include <timers.h>
+#include <swtimers.h>
+
+#define PB_POLL_MS (10)     // periodo de muestreo de pb_getchar_async mientras espera la presin o depresin
+
+static swtimer_t pb_timer;
+static enum { wait_keydown, keydown_delay, wait_keyup, keyup_delay } pb_state;
+static uint8 pb_code;
+static void (*pb_callback)( uint8 scancode );
 
 extern void isr_PB_dummy( void );
 
+static void pb_step( void *arg );
+
 void pbs_init( void )
 {
-    timers_init();
+    swtimer_init( &pb_timer, pb_step, NULL );
 }
 
 uint8 pb_scan( void )
@@ -74,6 +85,49 @@ uint8 pb_timeout_getchar( uint16 ms )
 
 }
 
+void pb_getchar_async( void (*callback)( uint8 scancode ) )
+{
+    INT_DISABLE;
+    pb_callback = callback;
+    pb_state = wait_keydown;
+    swtimer_start( &pb_timer, PB_POLL_MS, TIMER_ONE_SHOT );
+    INT_ENABLE;
+}
+
+/*
+** Cada paso se ejecuta en la RTI del timer5 y programa el siguiente; sigue los mismos pasos que pb_getchar
+*/
+static void pb_step( void *arg )
+{
+    switch( pb_state )
+    {
+        case wait_keydown:
+            if( pb_scan() != PB_FAILURE )
+            {
+                pb_state = keydown_delay;
+                swtimer_start( &pb_timer, PB_KEYDOWN_DELAY, TIMER_ONE_SHOT );
+                return;
+            }
+            break;
+        case keydown_delay:
+            pb_code = pb_scan();
+            pb_state = wait_keyup;
+            break;
+        case wait_keyup:
+            if( pb_scan() == PB_FAILURE )
+            {
+                pb_state = keyup_delay;
+                swtimer_start( &pb_timer, PB_KEYUP_DELAY, TIMER_ONE_SHOT );
+                return;
+            }
+            break;
+        case keyup_delay:
+            pb_callback( pb_code );
+            return;
+    }
+    swtimer_start( &pb_timer, PB_POLL_MS, TIMER_ONE_SHOT );
+}
+
 void pbs_open( void (*isr)(void) )
 {
     pISR_PB   = isr;
@@ -0,0 +1,358 @@
+#include <s3c44b0x.h>
+#include <s3cev40.h>
+#include <system.h>
+#include <swtimers.h>
+
+#define SWT_ROOT_BITS   (8)
+#define SWT_ROOT_SIZE   (1 << SWT_ROOT_BITS)
+#define SWT_ROOT_MASK   (SWT_ROOT_SIZE - 1)
+#define SWT_LEVEL_BITS  (6)
+#define SWT_LEVEL_SIZE  (1 << SWT_LEVEL_BITS)
+#define SWT_LEVEL_MASK  (SWT_LEVEL_SIZE - 1)
+#define SWT_LEVELS      (4)
+#define SWT_SHIFT( i )  (SWT_ROOT_BITS + (i)*SWT_LEVEL_BITS)   // bits que ignora el nivel i
+#define SWT_TICK_US     (1000000U / SWTIMERS_TPS)
+#define SWT_MAX_SLEEP   (64)    // ticks; TCNTB5 cuenta como mucho 65535 us
+
+/*
+** root[e & SWT_ROOT_MASK] guarda los temporizadores que vencen en los prximos 256 ticks
+** level[i][(e >> SWT_SHIFT(i)) & SWT_LEVEL_MASK] los que vencen antes de 1 << SWT_SHIFT(i+1) ticks;
+** cuando root completa una vuelta se reparte (cascade) la siguiente ranura del nivel 0, y as sucesivamente
+*/
+static swtimer_t *root[SWT_ROOT_SIZE];
+static swtimer_t *level[SWT_LEVELS][SWT_LEVEL_SIZE];
+static volatile uint32 now = 0;     // prximo tick a procesar
+static boolean ready = FALSE;
+static boolean running = FALSE;     // el timer5 se arranca con el primer swtimer_start
+static const char swtimers_owner[] = "swtimers";
+static boolean tickless = FALSE;
+static uint32 due_us;               // en modo sin tick, instante (timer4_clock_us) en que toca procesar el tick now
+static uint32 deadline;             // en modo sin tick, tick para el que est programado el timer5
+
+static void swtimers_run( void );
+static void swtimers_periodic( void );
+static uint32 swtimers_now( void );
+static void swtimer_link( swtimer_t *t );
+static void swtimer_unlink( swtimer_t *t );
+static void swtimers_cascade( uint8 i );
+static void swtimers_tick( void );
+static void swtimers_catchup( void );
+static uint32 swtimers_next( void );
+static void swtimers_program( uint32 tick );
+static void swtimers_idle( void );
+static void isr_swtimers( void ) __attribute__ ((interrupt ("IRQ")));
+
+/*
+** Solo reserva el timer5 y vaca la rueda; hasta que se arranca el primer temporizador no genera interrupciones
+*/
+uint8 swtimers_init( void )
+{
+    uint16 i, j;
+    uint8 err;
+
+    if( ready )
+        return TIMER_OK;
+    err = timer_alloc( 5, 3, 3, swtimers_owner );  //N=3+1, D=16
+    if( err != TIMER_OK )
+        return err;
+
+    for( i=0; i<SWT_ROOT_SIZE; i++ )
+        root[i] = NULL;
+    for( i=0; i<SWT_LEVELS; i++ )
+        for( j=0; j<SWT_LEVEL_SIZE; j++ )
+            level[i][j] = NULL;
+    now = 0;
+    ready = TRUE;
+    return TIMER_OK;
+}
+
+/*
+** Instala la RTI y arranca el timer5 (en modo sin tick, programado para el primer vencimiento)
+** Si no puede reservarse el timer5 los temporizadores quedan enlazados pero no vencen
+*/
+static void swtimers_run( void )
+{
+    if( swtimers_init() != TIMER_OK )
+        return;
+    running = TRUE;
+    timer_open( 5, isr_swtimers, SWT_TICK_US, TIMER_INTERVAL );
+    if( tickless )
+    {
+        due_us = timer4_clock_us() + SWT_TICK_US;
+        swtimers_program( swtimers_next() );
+    }
+    else
+        timer_start( 5 );
+}
+
+/*
+** El timer5 cuenta a 1 MHz (64 MHz / (3+1) / 16) y se recarga cada 1000 cuentas
+*/
+static void swtimers_periodic( void )
+{
+    timer_open( 5, NULL, SWT_TICK_US, TIMER_INTERVAL );
+    timer_start( 5 );
+}
+
+/*
+** Al entrar en el modo sin tick el siguiente tick se procesa dentro de 1 ms, igual que con el tick peridico;
+** al salir se procesan antes los ticks que hayan vencido desde la ltima interrupcin
+*/
+void swtimers_tickless( boolean on )
+{
+    INT_DISABLE;
+    if( !running )
+    {
+        tickless = on;              // swtimers_run lo tendr en cuenta al arrancar el timer5
+        sys_idle_hook( on ? swtimers_idle : NULL );
+    }
+    else if( on && !tickless )
+    {
+        tickless = TRUE;
+        due_us = timer4_clock_us() + SWT_TICK_US;
+        swtimers_program( swtimers_next() );
+        sys_idle_hook( swtimers_idle );
+    }
+    else if( !on && tickless )
+    {
+        sys_idle_hook( NULL );
+        swtimers_catchup();
+        tickless = FALSE;
+        swtimers_periodic();
+    }
+    INT_ENABLE;
+}
+
+uint32 swtimers_ticks( void )
+{
+    uint32 ticks;
+
+    INT_DISABLE;
+    ticks = swtimers_now();
+    INT_ENABLE;
+    return ticks;
+}
+
+/*
+** En modo sin tick now puede ir retrasado respecto al reloj hasta la prxima interrupcin del timer5
+*/
+static uint32 swtimers_now( void )
+{
+    int32 late;
+
+    if( !tickless || !running )
+        return now;
+    late = timer4_clock_us() - due_us;
+    return (late < 0) ? now : now + late / SWT_TICK_US + 1;
+}
+
+void swtimer_init( swtimer_t *t, void (*callback)( void *arg ), void *arg )
+{
+    t->next     = NULL;
+    t->pprev    = NULL;
+    t->expires  = 0;
+    t->period   = 0;
+    t->callback = callback;
+    t->arg      = arg;
+}
+
+void swtimer_start( swtimer_t *t, uint32 ms, uint8 mode )
+{
+    INT_DISABLE;
+    if( !running )
+        swtimers_run();
+    if( t->pprev )
+        swtimer_unlink( t );
+    t->expires = swtimers_now() + ms;
+    t->period  = (mode == TIMER_INTERVAL) ? ms : 0;
+    swtimer_link( t );
+    if( tickless && (int32)(t->expires - deadline) < 0 )
+        swtimers_program( t->expires );
+    INT_ENABLE;
+}
+
+void swtimer_stop( swtimer_t *t )
+{
+    INT_DISABLE;
+    if( t->pprev )
+        swtimer_unlink( t );
+    INT_ENABLE;
+}
+
+void swtimer_delay( swtimer_t *t, uint32 ms )
+{
+    swtimer_init( t, NULL, NULL );
+    swtimer_start( t, ms, TIMER_ONE_SHOT );
+}
+
+boolean swtimer_active( swtimer_t *t )
+{
+    return t->pprev != NULL;
+}
+
+/*
+** Elige la ranura segn lo que falta para el vencimiento; los ya vencidos van a la prxima ranura a procesar
+*/
+static void swtimer_link( swtimer_t *t )
+{
+    uint32 delta;
+    swtimer_t **slot;
+    uint8 i;
+
+    delta = t->expires - now;
+    if( (int32)delta < 0 )
+        slot = &root[now & SWT_ROOT_MASK];
+    else if( delta < SWT_ROOT_SIZE )
+        slot = &root[t->expires & SWT_ROOT_MASK];
+    else
+    {
+        for( i=0; i<SWT_LEVELS-1 && delta >= (1U << SWT_SHIFT( i+1 )); i++ );
+        slot = &level[i][(t->expires >> SWT_SHIFT( i )) & SWT_LEVEL_MASK];
+    }
+
+    t->next = *slot;
+    if( t->next )
+        t->next->pprev = &t->next;
+    t->pprev = slot;
+    *slot = t;
+}
+
+static void swtimer_unlink( swtimer_t *t )
+{
+    *t->pprev = t->next;
+    if( t->next )
+        t->next->pprev = t->pprev;
+    t->next = NULL;
+    t->pprev = NULL;
+}
+
+/*
+** Reparte en los niveles inferiores la ranura del nivel i que empieza en el tick now
+** Si es la ranura 0 del nivel, antes hay que repartir la del nivel superior
+*/
+static void swtimers_cascade( uint8 i )
+{
+    uint8 j;
+    swtimer_t *t, *next;
+
+    j = (now >> SWT_SHIFT( i )) & SWT_LEVEL_MASK;
+    if( !j && i < SWT_LEVELS-1 )
+        swtimers_cascade( i+1 );
+
+    t = level[i][j];
+    level[i][j] = NULL;
+    for( ; t; t = next )
+    {
+        next = t->next;
+        swtimer_link( t );
+    }
+}
+
+/*
+** Todos los temporizadores de la ranura vencen en este tick; se pasan a una lista aparte para que las funciones
+** de vencimiento puedan parar o rearrancar cualquier temporizador, incluidos los de esa misma lista
+*/
+static void swtimers_tick( void )
+{
+    swtimer_t *expired, *t;
+    uint8 index;
+
+    index = now & SWT_ROOT_MASK;
+    if( !index )
+        swtimers_cascade( 0 );
+
+    expired = root[index];
+    root[index] = NULL;
+    if( expired )
+        expired->pprev = &expired;
+    now++;
+
+    while( (t = expired) )
+    {
+        swtimer_unlink( t );
+        if( t->period )
+        {
+            t->expires += t->period;
+            swtimer_link( t );
+        }
+        if( t->callback )
+            t->callback( t->arg );
+    }
+}
+
+/*
+** Procesa todos los ticks que han vencido segn el reloj del timer4, sin acumular deriva
+*/
+static void swtimers_catchup( void )
+{
+    uint32 clock;
+
+    clock = timer4_clock_us();
+    while( (int32)(clock - due_us) >= 0 )
+    {
+        swtimers_tick();
+        due_us += SWT_TICK_US;
+    }
+}
+
+/*
+** Devuelve el primer tick con temporizadores en root, sin pasar de SWT_MAX_SLEEP ticks ni del final de la
+** vuelta de root (en la ranura 0 hay que repartir el nivel 0, que puede traer vencimientos cercanos)
+*/
+static uint32 swtimers_next( void )
+{
+    uint32 k;
+    uint8 index;
+
+    for( k=0; k<SWT_MAX_SLEEP; k++ )
+    {
+        index = (now + k) & SWT_ROOT_MASK;
+        if( !index || root[index] )
+            break;
+    }
+    return now + k;
+}
+
+/*
+** Programa el timer5 en modo one-shot para que interrumpa cuando toque procesar el tick indicado
+*/
+static void swtimers_program( uint32 tick )
+{
+    int32 wait;
+
+    deadline = tick;
+    wait = due_us + (tick - now)*SWT_TICK_US - timer4_clock_us();
+    if( wait < 1 )
+        wait = 1;
+    timer_open( 5, NULL, wait, TIMER_ONE_SHOT );
+    timer_start( 5 );
+}
+
+/*
+** Lo llama sleep() antes de pasar a IDLE: si se han parado temporizadores el timer5 puede esperar ms
+*/
+static void swtimers_idle( void )
+{
+    INT_DISABLE;
+    if( running )
+        swtimers_program( swtimers_next() );
+    INT_ENABLE;
+}
+
+/*
+** En modo sin tick la interrupcin se borra antes de reprogramar para no perder una que llegue enseguida
+*/
+static void isr_swtimers( void )
+{
+    if( tickless )
+    {
+        swtimers_catchup();
+        I_ISPC = BIT_TIMER5;
+        swtimers_program( swtimers_next() );
+    }
+    else
+    {
+        swtimers_tick();
+        I_ISPC = BIT_TIMER5;
+    }
+}
@@ -35,6 +35,8 @@
   asm volatile ( "orr r0, r0, %0" : : "i" (value<<6) : ); \
   asm volatile ( "msr cpsr_c, r0" );
   
+static void (*idle_hook)( void ) = NULL;
+
 static void port_init( void );
 static void install_dummy_isr( void );
 static void show_sys_info( void );
@@ -408,11 +410,18 @@ static void show_sys_info( void )
 	uart0_puts( "Autoria: Agustin Buendia. Informatica UCM 13/10/2021" );
 }
 
-inline void sleep( void )
+void sleep( void )
 {
+    if( idle_hook )
+        idle_hook();
     CLKCON |= (1 << 2);    // Pone a la CPU en estado IDLE
 }
 
+void sys_idle_hook( void (*hook)(void) )
+{
+    idle_hook = hook;
+}
+
 static void sys_recovery( void ) 
 {
     uint8 mode;
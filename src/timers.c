@@ -1,16 +1,64 @@
 #include <s3c44b0x.h>
 #include <s3cev40.h>
+#include <system.h>
 #include <timers.h>
 
 extern void isr_TIMER0_dummy( void );
+extern void isr_TIMER1_dummy( void );
+extern void isr_TIMER2_dummy( void );
+extern void isr_TIMER3_dummy( void );
+extern void isr_TIMER4_dummy( void );
+extern void isr_TIMER5_dummy( void );
+
+/*
+** Registros de cada temporizador: TCNTBn, TCMPBn y TCNTOn se repiten cada 3 palabras salvo en el timer5, que no tiene TCMPB5
+** En TCON el timer0 ocupa los bits 4:0 y el timer n los 4n+7:4n+4 (el timer5 no tiene inversor, la recarga es su bit 2)
+*/
+#define TIMER_TCNTB( n )    ((&TCNTB0)[3*(n)])
+#define TIMER_TCMPB( n )    ((&TCMPB0)[3*(n)])
+#define TIMER_TCNTO( n )    (*((n) == 5 ? &TCNTO5 : &(&TCNTO0)[3*(n)]))
+#define TIMER_ISR( n )      ((&pISR_TIMER0)[-(n)])
+#define TIMER_BIT( n )      (BIT_TIMER0 >> (n))
+#define TIMER_TCON( n )     ((n) ? 4*(n) + 4 : 0)
+#define TIMER_RELOAD( n )   ((n) == 5 ? 2 : 3)
+
+static void (* const dummy_isr[6])( void ) = { isr_TIMER0_dummy, isr_TIMER1_dummy, isr_TIMER2_dummy, isr_TIMER3_dummy, isr_TIMER4_dummy, isr_TIMER5_dummy };
+
+static const char *owner[6];        // NULL si el temporizador est libre
+static uint8 pair_prescaler[3];     // preescalador de cada pareja, vlido si alguno de sus temporizadores est reservado
+
+static const char tick_owner[]    = "timer0";
+static const char clock_owner[]   = "timer4";
+static const char delay_owner[]   = "delay";
+static const char measure_owner[] = "measure";
+static const char timeout_owner[] = "timeout";
+
+static uint8 measure_ch = TIMER_NONE;   // temporizador de la medida en curso (timer3_start/timer3_stop)
+static uint8 timeout_ch = TIMER_NONE;   // temporizador del plazo en curso (timer3_start_timeout/timer3_timeout)
+static boolean ready = FALSE;
 
 static uint32 loop_ms = 0;
 static uint32 loop_s = 0;
+static volatile uint32 clock_hi;   // desbordamientos del timer4 (cada 65536 us)
 
 static void sw_delay_init( void );
+static void timer_count( uint8 n, uint16 count );
+static void isr_clock( void ) __attribute__ ((interrupt ("IRQ")));
 
+/*
+** Solo la primera llamada reinicia los temporizadores; las siguientes no tocan las reservas ni los que estn en marcha
+*/
 void timers_init( void )
 {
+    uint8 i;
+
+    if( ready )
+        return;
+    ready = TRUE;
+
+    for( i=0; i<6; i++ )
+        owner[i] = NULL;
+
     TCFG0 = 0;//(TCFG0 & ~(0xff<<8))|(63 <<8);
     TCFG1 = 0;//(TCFG1 & ~(0xf))|(32<<12);
 
@@ -42,19 +90,26 @@ static void sw_delay_init( void )
     loop_ms = loop_s / 1000;
 };
 
+/*
+** Los retardos, las medidas y los plazos reservan cada uno un temporizador libre a 10 kHz (N=199+1, D=32) mientras
+** lo usan, as que pueden solaparse entre s y con otros dueos; los nombres timer3_* se conservan por compatibilidad
+*/
 void timer3_delay_ms( uint16 n )
 {
+    uint8 ch;
+
+    ch = timer_alloc_any( 199, 4, delay_owner );
+    if( ch == TIMER_NONE )
+    {
+        sw_delay_ms( n );
+        return;
+    }
     for( ; n; n-- )
     {
-    	TCFG0 = (TCFG0 & ~(0xff << 8)) | (199 << 8);
-		TCFG1 = (TCFG1 & ~(0xf << 12)) | (4 << 12);
-
-		TCNTB3 = 10;
-		TCON = (TCON & ~(0xf << 16)) | (1 << 17);
-		TCON = (TCON & ~(0xf << 16)) | (1 << 16);
-		while( !TCNTO3 );
-		while(TCNTO3);
+        timer_count( ch, 10 );
+        while( timer_read( ch ) );
     }
+    timer_free( ch );
 }
 
 void sw_delay_ms( uint16 n )
@@ -66,18 +121,20 @@ void sw_delay_ms( uint16 n )
 
 void timer3_delay_s( uint16 n )
 {
-	for( ; n; n-- )
-	{
-		TCFG0 = (TCFG0 & ~(0xff << 8)) | (199 << 8);
-		TCFG1 = (TCFG1 & ~(0xf << 12)) | (4 << 12);
-
-		TCNTB3 = 10000;
-		TCON = (TCON & ~(0xf << 16)) | (1 << 17);
-		TCON = (TCON & ~(0xf << 16)) | (1 << 16);
-		while( !TCNTO3 );
-		while(TCNTO3);
-	}
+    uint8 ch;
 
+    ch = timer_alloc_any( 199, 4, delay_owner );
+    if( ch == TIMER_NONE )
+    {
+        sw_delay_s( n );
+        return;
+    }
+    for( ; n; n-- )
+    {
+        timer_count( ch, 10000 );
+        while( timer_read( ch ) );
+    }
+    timer_free( ch );
 }
 
 void sw_delay_s( uint16 n )
@@ -87,89 +144,257 @@ void sw_delay_s( uint16 n )
     for( i=loop_s*n; i; i-- );
 }
 
-void timer3_start( void ) 
+void timer3_start( void )
 {
-    TCFG0 = (TCFG0 & ~(0xff << 8)) | (199 << 8);    
-    TCFG1 = (TCFG1 & ~(0xf << 12)) | (4 << 12);
-    
-    TCNTB3 = 0xffff; 
-    TCON = (TCON & ~(0xf << 16)) | (1 << 17);
-    TCON = (TCON & ~(0xf << 16)) | (1 << 16);
-    while( !TCNTO3 );
+    if( measure_ch == TIMER_NONE )
+        measure_ch = timer_alloc_any( 199, 4, measure_owner );
+    if( measure_ch != TIMER_NONE )
+        timer_count( measure_ch, 0xffff );
 }
 
 uint16 timer3_stop( void )
 {
-    TCON &= ~(1 << 16);
-    return 0xffff - TCNTO3;
+    uint16 elapsed;
+
+    if( measure_ch == TIMER_NONE )
+        return 0;
+    timer_stop( measure_ch );
+    elapsed = 0xffff - timer_read( measure_ch );
+    timer_free( measure_ch );
+    measure_ch = TIMER_NONE;
+    return elapsed;
 }
 
-void timer3_start_timeout( uint16 n ) 
+void timer3_start_timeout( uint16 n )
 {
-    TCFG0 = (TCFG0 & ~(0xff << 8)) | (199 << 8);          
-    TCFG1 = (TCFG1 & ~(0xf << 12)) | (4 << 12);
-    
-    TCNTB3 = n; 
-    TCON = (TCON & ~(0xf << 16)) | (1 << 17);
-    TCON = (TCON & ~(0xf << 16)) | (1 << 16);
-    while( !TCNTO3 );
-}
-
-uint16 timer3_timeout( )
-{
-    return !TCNTO3;
-}    
-
-void timer0_open_tick( void (*isr)(void), uint16 tps )
-{
-	pISR_TIMER0 = isr;
-	I_ISPC      = I_ISPC |(BIT_TIMER0); //cambiado
-	INTMSK     &= ~((BIT_TIMER0)|(BIT_GLOBAL));
-
-    if( tps > 0 && tps <= 10 ) {
-    	TCFG0  = (TCFG0 & ~(0xff)) | (49);//N=49
-		TCFG1  = (TCFG1 & ~(0xf)) | (4);//D=32
-        TCNTB0 = (40000U / tps);
-    } else if( tps > 10 && tps <= 100 ) {
-    	TCFG0  = (TCFG0 & ~(0xff)) | (9);//N=9
-		TCFG1  = (TCFG1 & ~(0xf)) | (3);//D=16
-        TCNTB0 = (400000U / (uint32) tps);
-    } else if( tps > 100 && tps <= 1000 ) {
-    	TCFG0  = (TCFG0 & ~(0xff)) | (1);//N=1
-		TCFG1  = (TCFG1 & ~(0xf)) | (2);//D=8
-        TCNTB0 = (4000000U / (uint32) tps);
-    } else if ( tps > 1000 ) {
-    	TCFG0  = (TCFG0 & ~(0xff));//N=0
-		TCFG1  = (TCFG1 & ~(0xf));//D=2
-        TCNTB0 = (32000000U / (uint32) tps);
+    if( timeout_ch == TIMER_NONE )
+        timeout_ch = timer_alloc_any( 199, 4, timeout_owner );
+    if( timeout_ch != TIMER_NONE )
+        timer_count( timeout_ch, n );
+}
+
+/*
+** El temporizador se libera al detectar que ha vencido; si el plazo no llega a vencer sigue reservado y lo reutiliza
+** el siguiente timer3_start_timeout
+*/
+uint16 timer3_timeout( void )
+{
+    if( timeout_ch == TIMER_NONE )
+        return TRUE;
+    if( timer_read( timeout_ch ) )
+        return FALSE;
+    timer_free( timeout_ch );
+    timeout_ch = TIMER_NONE;
+    return TRUE;
+}
+
+/*
+** Arranca el temporizador n en modo one-shot y espera a que el contador se cargue con count
+*/
+static void timer_count( uint8 n, uint16 count )
+{
+    timer_open( n, NULL, count, TIMER_ONE_SHOT );
+    timer_start( n );
+    while( !timer_read( n ) );
+}
+
+uint8 timer0_open_tick( void (*isr)(void), uint16 tps )
+{
+    uint8 err;
+    uint16 count;
+
+    if( tps == 0 )
+        return TIMER_INVALID;
+    if( tps <= 10 ) {
+        err = timer_alloc( 0, 49, 4, tick_owner );  //N=49, D=32
+        count = 40000U / tps;
+    } else if( tps <= 100 ) {
+        err = timer_alloc( 0, 9, 3, tick_owner );   //N=9, D=16
+        count = 400000U / (uint32) tps;
+    } else if( tps <= 1000 ) {
+        err = timer_alloc( 0, 1, 2, tick_owner );   //N=1, D=8
+        count = 4000000U / (uint32) tps;
+    } else {
+        err = timer_alloc( 0, 0, 0, tick_owner );   //N=0, D=2
+        count = 32000000U / (uint32) tps;
     }
+    if( err != TIMER_OK )
+        return err;
 
-    TCON = (TCON & ~(0x3)) | (1<<1)|(1<<3);
-	TCON = (TCON & ~(0x3)) | (1<<0)|(1<<3);
+    timer_open( 0, isr, count, TIMER_INTERVAL );
+    timer_start( 0 );
+    return TIMER_OK;
 }
 
-void timer0_open_ms( void (*isr)(void), uint16 ms, uint8 mode )
+uint8 timer0_open_ms( void (*isr)(void), uint16 ms, uint8 mode )
 {
-    pISR_TIMER0 = isr;
-    I_ISPC      = I_ISPC |(BIT_TIMER0); //cambiado &~
-    INTMSK     &= ~((BIT_TIMER0)|(BIT_GLOBAL));
+    uint8 err;
 
-    TCFG0  = (TCFG0 & ~(0xff)) | (199);//N=199+1
-	TCFG1  = (TCFG1 & ~(0xf)) | (4);//D=32
-    TCNTB0 = 10*ms;
+    err = timer_alloc( 0, 199, 4, tick_owner );     //N=199+1, D=32
+    if( err != TIMER_OK )
+        return err;
 
-    TCON = (TCON & ~(0xf)) | (1<<1)| mode<<3;
-    TCON = (TCON & ~(0xf)) | (1<<0)| mode<<3;
+    timer_open( 0, isr, 10*ms, mode );
+    timer_start( 0 );
+    return TIMER_OK;
 }
 
 void timer0_close( void )
 {
-    TCNTB0 = 0x0;
-    TCMPB0 = 0x0;
+    timer_free( 0 );
+}
 
-    TCON = (TCON & ~(0x11)) | (1<<1);
-    TCON = (TCON & ~(0x11)) | (1<<0);
-    
-    INTMSK     |= BIT_TIMER0;
-    pISR_TIMER0 = isr_TIMER0_dummy;
+/*
+** El timer4 cuenta en bucle de 0xffff a 0 a 1 MHz (64 MHz / (3+1) / 16) y cada recarga suma 1 a clock_hi
+** El preescalador es compartido con el timer5, que solo admite divisores hasta 1/16
+*/
+uint8 timer4_open_clock( void )
+{
+    uint8 err;
+
+    err = timer_alloc( 4, 3, 3, clock_owner );      //N=3+1, D=16
+    if( err != TIMER_OK )
+        return err;
+
+    clock_hi = 0;
+    timer_open( 4, isr_clock, 0xffff, TIMER_INTERVAL );
+    timer_start( 4 );
+    return TIMER_OK;
+}
+
+/*
+** Con las interrupciones deshabilitadas clock_hi no cambia; si la recarga ya se ha producido pero su
+** interrupcin est pendiente (lectura desde otra RTI o justo tras la recarga) se cuenta aqu y se relee TCNTO4
+** Se consulta INTPND: I_ISPR solo marca la interrupcin en servicio, no las que esperan
+*/
+uint64 timer4_clock_us64( void )
+{
+    uint32 hi, cnt;
+
+    INT_DISABLE;
+    hi = clock_hi;
+    cnt = TCNTO4;
+    if( INTPND & BIT_TIMER4 )
+    {
+        hi++;
+        cnt = TCNTO4;
+    }
+    INT_ENABLE;
+    return ((uint64)hi << 16) + (0xffff - cnt);
+}
+
+uint32 timer4_clock_us( void )
+{
+    return (uint32)timer4_clock_us64();
+}
+
+/*
+** Los dueos se comparan por puntero: cada uno debe usar siempre la misma cadena
+** En los timers 4 y 5 el mux 4 no es el divisor 1/32 sino la entrada externa TCLK, por eso no se admite
+** Puede llamarse desde RTIs: la comprobacin y la reserva se hacen con las interrupciones deshabilitadas
+*/
+uint8 timer_alloc( uint8 n, uint8 prescaler, uint8 mux, const char *who )
+{
+    uint8 pair, err;
+
+    if( n > 5 || mux > 4 || (mux == 4 && n >= 4) )
+        return TIMER_INVALID;
+    pair = n >> 1;
+
+    INT_DISABLE;
+    if( owner[n] && owner[n] != who )
+        err = TIMER_BUSY;
+    else if( owner[n ^ 1] && pair_prescaler[pair] != prescaler )
+        err = TIMER_CONFLICT;
+    else
+    {
+        owner[n] = who;
+        pair_prescaler[pair] = prescaler;
+        TCFG0 = (TCFG0 & ~(0xff << 8*pair)) | (prescaler << 8*pair);
+        TCFG1 = (TCFG1 & ~(0xf << 4*n)) | (mux << 4*n);
+        err = TIMER_OK;
+    }
+    INT_ENABLE;
+    return err;
+}
+
+uint8 timer_alloc_any( uint8 prescaler, uint8 mux, const char *who )
+{
+    uint8 n, found;
+
+    found = TIMER_NONE;
+    INT_DISABLE;
+    for( n=0; n<6 && found == TIMER_NONE; n++ )
+        if( !owner[n] && owner[n ^ 1] && pair_prescaler[n >> 1] == prescaler && timer_alloc( n, prescaler, mux, who ) == TIMER_OK )
+            found = n;
+    for( n=0; n<6 && found == TIMER_NONE; n++ )
+        if( !owner[n] && timer_alloc( n, prescaler, mux, who ) == TIMER_OK )
+            found = n;
+    INT_ENABLE;
+    return found;
+}
+
+void timer_free( uint8 n )
+{
+    if( n > 5 )
+        return;
+    timer_stop( n );
+    TIMER_TCNTB( n ) = 0x0;
+    if( n < 5 )
+        TIMER_TCMPB( n ) = 0x0;
+
+    INTMSK      |= TIMER_BIT( n );
+    TIMER_ISR( n ) = (uint32) dummy_isr[n];
+    owner[n] = NULL;
+}
+
+const char *timer_owner( uint8 n )
+{
+    return (n > 5) ? NULL : owner[n];
+}
+
+/*
+** La actualizacin manual carga TCNTB en el contador; timer_start la desactiva al arrancar
+*/
+void timer_open( uint8 n, void (*isr)(void), uint16 count, uint8 mode )
+{
+    uint8 shift;
+
+    if( isr )
+    {
+        TIMER_ISR( n ) = (uint32) isr;
+        I_ISPC         = TIMER_BIT( n );
+        INTMSK        &= ~(TIMER_BIT( n )|(BIT_GLOBAL));
+    }
+
+    TIMER_TCNTB( n ) = count;
+    if( n < 5 )
+        TIMER_TCMPB( n ) = 0x0;
+
+    shift = TIMER_TCON( n );
+    TCON = (TCON & ~(0xf << shift)) | (1 << (shift+1)) | (mode << (shift + TIMER_RELOAD( n )));
+}
+
+void timer_start( uint8 n )
+{
+    uint8 shift;
+
+    shift = TIMER_TCON( n );
+    TCON = (TCON & ~(0x3 << shift)) | (1 << shift);
+}
+
+void timer_stop( uint8 n )
+{
+    TCON &= ~(1 << TIMER_TCON( n ));
+}
+
+uint16 timer_read( uint8 n )
+{
+    return TIMER_TCNTO( n );
+}
+
+static void isr_clock( void )
+{
+    clock_hi++;
+    I_ISPC = BIT_TIMER4;
 }
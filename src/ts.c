@@ -1,11 +1,14 @@
 #include <s3c44b0x.h>
 #include <s3cev40.h>
+#include <system.h>
 #include <timers.h>
+#include <swtimers.h>
 #include <adc.h>
 #include <lcd.h>
 #include <ts.h>
 
 #define PX_ERROR    (5)
+#define TS_POLL_MS  (10)    // periodo de muestreo de ts_getpos_async mientras espera la pulsacin o despulsacin
 
 static uint16 Vxmin = 0;
 static uint16 Vxmax = 0;
@@ -14,17 +17,25 @@ static uint16 Vymax = 0;
 
 static uint8 state;
 
+static swtimer_t ts_timer;
+static enum { wait_down, down_delay, scan, wait_up, up_delay } ts_state;
+static uint16 ts_Vx, ts_Vy;
+static void (*ts_callback)( uint16 x, uint16 y );
+
 extern void isr_TS_dummy( void );
 
 static void ts_scan( uint16 *Vx, uint16 *Vy );
 static void ts_calibrate( void );
 static void ts_sample2coord( uint16 Vx, uint16 Vy, uint16 *x, uint16 *y );
+static void ts_step( void *arg );
+static void ts_scan_x( uint16 Vx );
+static void ts_scan_y( uint16 Vy );
 
 void ts_init( void )
 {
-    timers_init();  
     lcd_init();
     adc_init();
+    swtimer_init( &ts_timer, ts_step, NULL );
     PDATE = (PDATE & ~(0xf<<4)) | (11<<4);
     sw_delay_ms( 1 );
     ts_on();
@@ -124,6 +135,77 @@ uint8 ts_timeout_getpos( uint16 *x, uint16 *y, uint16 ms )
 	sw_delay_ms(TS_UP_DELAY);
 }
 
+void ts_getpos_async( void (*callback)( uint16 x, uint16 y ) )
+{
+    INT_DISABLE;
+    ts_callback = callback;
+    ts_state = wait_down;
+    swtimer_start( &ts_timer, TS_POLL_MS, TIMER_ONE_SHOT );
+    INT_ENABLE;
+}
+
+/*
+** Cada paso se ejecuta en la RTI del timer5 y programa el siguiente; sigue los mismos pasos que ts_getpos
+*/
+static void ts_step( void *arg )
+{
+    uint16 x, y;
+
+    switch( ts_state )
+    {
+        case wait_down:
+            if( ts_pressed() )
+            {
+                ts_state = down_delay;
+                swtimer_start( &ts_timer, TS_DOWN_DELAY, TIMER_ONE_SHOT );
+                return;
+            }
+            break;
+        case down_delay:
+            PDATE = (PDATE & ~(0xf<<4)) | (6<<4);
+            if( adc_getSample_async( ADC_AIN1, ts_scan_x ) )
+            {
+                ts_state = scan;
+                return;
+            }
+            break;          // conversor ocupado: se reintenta en el siguiente sondeo
+        case scan:          // vuelta a reposo de la touchscreen tras ts_scan_y
+            ts_state = wait_up;
+            break;
+        case wait_up:
+            if( !ts_pressed() )
+            {
+                ts_state = up_delay;
+                swtimer_start( &ts_timer, TS_UP_DELAY, TIMER_ONE_SHOT );
+                return;
+            }
+            break;
+        case up_delay:
+            ts_sample2coord( ts_Vx, ts_Vy, &x, &y );
+            ts_callback( x, y );
+            return;
+    }
+    swtimer_start( &ts_timer, TS_POLL_MS, TIMER_ONE_SHOT );
+}
+
+static void ts_scan_x( uint16 Vx )
+{
+    ts_Vx = Vx;
+    PDATE = (PDATE & ~(0xf<<4)) |(9<<4);
+    if( !adc_getSample_async( ADC_AIN0, ts_scan_y ) )
+    {
+        ts_state = down_delay;
+        swtimer_start( &ts_timer, TS_POLL_MS, TIMER_ONE_SHOT );
+    }
+}
+
+static void ts_scan_y( uint16 Vy )
+{
+    ts_Vy = Vy;
+    PDATE = (PDATE & ~(0xf<<4)) | (11<<4);
+    swtimer_start( &ts_timer, 1, TIMER_ONE_SHOT );
+}
+
 static void ts_scan( uint16 *Vx, uint16 *Vy )
 {
     PDATE = (PDATE & ~(0xf<<4)) | (6<<4);
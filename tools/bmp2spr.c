@@ -0,0 +1,345 @@
+/*-------------------------------------------------------------------
+**
+**  Fichero:
+**    bmp2spr.c  17/10/2026
+**
+**    Programacin de Sistemas y Dispositivos
+**    Facultad de Informtica. Universidad Complutense de Madrid
+**
+**  Propsito:
+**    Compilador de grficos para el PC (Linux) que convierte un BMP
+**    de 16 colores (4b/px) al formato nativo de bitmap del driver
+**    de LCD (lcd_bitmap_t)
+**
+**  Notas de diseo:
+**    - Compilacin: gcc -O2 -o bmp2spr bmp2spr.c
+**    - Uso: bmp2spr [-c] fichero.bmp fichero.spr
+**      con -c las filas se comprimen (formato 1, ver lcd_bitmap_t);
+**      solo el fondo puede ir comprimido, los sprites deben ir sin -c
+**    - Uso: bmp2spr -a fichero.ani frame0.bmp frame1.bmp ...
+**      genera una animacin (ver lcd_anim_t) con frame0 como keyframe
+**      y, para cada frame, los bytes que cambian respecto al anterior
+**    - El fichero generado se carga en memoria tal cual con el
+**      comando restore del GDB (ver load_spr.txt)
+**    - Formato de salida (little-endian, 12 bytes de cabecera):
+**        uint32 magic   "SPR4"
+**        uint16 width   anchura en pixeles
+**        uint16 height  altura en pixeles
+**        uint16 stride  bytes por fila, mltiplo de 4
+**        uint16 format  0 (sin comprimir) o 1 (RLE)
+**      seguido de height filas de stride bytes ordenadas de arriba
+**      a abajo, con los ndices de color ya invertidos (0 = blanco)
+**    - Formato RLE: las filas forman un nico flujo de paquetes
+**        0ccccccc seguido de c+1 bytes literales
+**        1ccccccc seguido de un byte que se repite c+2 veces
+**    - Formato de animacin (12 bytes de cabecera):
+**        uint32 magic   "ANI4"
+**        uint16 width, height, stride
+**        uint16 frames
+**      seguido de la keyframe (height filas de stride bytes) y de
+**      frames deltas; el ltimo transforma el ltimo frame en el 0
+**    - Delta: spans de 4 bytes de cabecera (fila en 16 bits, byte
+**      inicial, nmero de bytes n) seguidos de n bytes; termina con
+**      un span de 0 bytes
+**    - El byte inicial es de 8 bits: las filas de una animacin
+**      tienen como mucho 256 bytes (512 pixeles)
+**    - Debe mantenerse sincronizado con lcd_bitmap_t y lcd_anim_t en lcd.h
+**
+**-----------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#define SPR_MAGIC   (0x34525053)    /* "SPR4" */
+#define ANI_MAGIC   (0x34494e41)    /* "ANI4" */
+#define ANI_GAP     (4)             /* bytes iguales que se copian en vez de abrir un span nuevo */
+#define SPR_RAW     (0)
+#define SPR_RLE     (1)
+
+static uint32_t get32( const uint8_t *p )
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint16_t get16( const uint8_t *p )
+{
+    return p[0] | (p[1] << 8);
+}
+
+static void put32( uint8_t *p, uint32_t v )
+{
+    p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+}
+
+static void put16( uint8_t *p, uint16_t v )
+{
+    p[0] = v; p[1] = v >> 8;
+}
+
+static uint8_t *read_file( const char *name, long *size )
+{
+    FILE *f;
+    uint8_t *buf;
+
+    if( !(f = fopen( name, "rb" )) )
+        return NULL;
+    fseek( f, 0, SEEK_END );
+    *size = ftell( f );
+    fseek( f, 0, SEEK_SET );
+    buf = malloc( *size );
+    if( buf && fread( buf, 1, *size, f ) != (size_t)*size )
+    {
+        free( buf );
+        buf = NULL;
+    }
+    fclose( f );
+    return buf;
+}
+
+/*
+** Comprime n bytes en out (que debe admitir n + n/128 + 1 bytes) y devuelve el tamao resultante
+** Las repeticiones de 3 o ms bytes se codifican como paquete de repeticin; el resto como literales
+*/
+static long rle_pack( const uint8_t *in, long n, uint8_t *out )
+{
+    long i, j, lit, o;
+
+    o = 0;
+    lit = 0;
+    for( i=0; i<n; )
+    {
+        for( j=i+1; j<n && j-i < 129 && in[j] == in[i]; j++ );
+        if( j-i >= 3 )
+        {
+            if( lit )
+            {
+                out[o++] = lit - 1;
+                memcpy( out + o, in + i - lit, lit );
+                o += lit;
+                lit = 0;
+            }
+            out[o++] = 0x80 | (j-i-2);
+            out[o++] = in[i];
+            i = j;
+        }
+        else
+        {
+            i++;
+            if( ++lit == 128 )
+            {
+                out[o++] = lit - 1;
+                memcpy( out + o, in + i - lit, lit );
+                o += lit;
+                lit = 0;
+            }
+        }
+    }
+    if( lit )
+    {
+        out[o++] = lit - 1;
+        memcpy( out + o, in + i - lit, lit );
+        o += lit;
+    }
+    return o;
+}
+
+/*
+** Lee un BMP de 4b/px y devuelve sus filas en formato nativo (de arriba a abajo, colores invertidos, stride mltiplo de 4)
+** Muestra el error y devuelve NULL si no es vlido
+*/
+static uint8_t *load_bmp( const char *name, int32_t *width, int32_t *height, uint32_t *dstStride )
+{
+    uint8_t *bmp, *spr, *row;
+    long size;
+    uint32_t offset, srcStride;
+    int bottomUp, y, x;
+
+    if( !(bmp = read_file( name, &size )) || size < 54 || bmp[0] != 'B' || bmp[1] != 'M' )
+    {
+        fprintf( stderr, "%s: no es un BMP valido\n", name );
+        return NULL;
+    }
+
+    offset  = get32( bmp + 10 );
+    *width  = (int32_t)get32( bmp + 18 );
+    *height = (int32_t)get32( bmp + 22 );
+    if( get16( bmp + 28 ) != 4 || get32( bmp + 30 ) != 0 || *width <= 0 || *width > 0xffff )
+    {
+        fprintf( stderr, "%s: solo se admiten BMP de 4b/px sin comprimir\n", name );
+        return NULL;
+    }
+    bottomUp = *height > 0;
+    if( !bottomUp )
+        *height = -*height;
+
+    srcStride = ((*width*4 + 31) / 32) * 4;
+    *dstStride = ((*width + 7) / 8) * 4;
+    if( offset + srcStride*(*height) > (uint32_t)size )
+    {
+        fprintf( stderr, "%s: fichero truncado\n", name );
+        return NULL;
+    }
+
+    spr = calloc( *dstStride, *height );
+    for( y=0; y<*height; y++ )
+    {
+        row = bmp + offset + srcStride*(bottomUp ? *height-1-y : y);
+        for( x=0; x<(*width+1)/2; x++ )
+            spr[y*(*dstStride) + x] = ~row[x];
+    }
+    free( bmp );
+    return spr;
+}
+
+/*
+** Escribe en out los spans de bytes en los que to difiere de from (n bytes por fila) y devuelve su tamao
+** Huecos de hasta ANI_GAP bytes iguales se copian dentro del span, ya que abrir otro cuesta 4 bytes de cabecera
+*/
+static long ani_delta( const uint8_t *from, const uint8_t *to, int32_t height, uint32_t stride, uint32_t n, uint8_t *out )
+{
+    long o;
+    int32_t y;
+    uint32_t x, end, gap;
+
+    o = 0;
+    for( y=0; y<height; y++ )
+        for( x=0; x<n; )
+        {
+            if( from[y*stride + x] == to[y*stride + x] )
+            {
+                x++;
+                continue;
+            }
+            for( end=x+1, gap=0; end<n && end-x < 255 && gap <= ANI_GAP; end++ )
+                gap = (from[y*stride + end] == to[y*stride + end]) ? gap+1 : 0;
+            end -= gap;
+            out[o++] = y;
+            out[o++] = y >> 8;
+            out[o++] = x;
+            out[o++] = end - x;
+            memcpy( out + o, to + y*stride + x, end - x );
+            o += end - x;
+            x = end;
+        }
+    memset( out + o, 0, 4 );
+    return o + 4;
+}
+
+/*
+** bmp2spr -a fichero.ani frame0.bmp frame1.bmp ...
+*/
+static int make_anim( int frames, char *names[], const char *out )
+{
+    uint8_t **spr, *delta;
+    uint8_t hdr[12];
+    int32_t width, height, w, h;
+    uint32_t stride, s;
+    long size, total;
+    int i;
+    FILE *f;
+
+    spr = calloc( frames, sizeof(uint8_t *) );
+    for( i=0; i<frames; i++ )
+    {
+        if( !(spr[i] = load_bmp( names[i], &w, &h, &s )) )
+            return 1;
+        if( !i )
+        {
+            width = w;
+            height = h;
+            stride = s;
+        }
+        else if( w != width || h != height )
+        {
+            fprintf( stderr, "%s: los frames deben tener el mismo tamao\n", names[i] );
+            return 1;
+        }
+    }
+    if( (width+1)/2 > 256 || height > 0xffff )
+    {
+        fprintf( stderr, "%s: demasiado ancho para una animacin (mximo 512 pixeles)\n", names[0] );
+        return 1;
+    }
+
+    if( !(f = fopen( out, "wb" )) )
+    {
+        fprintf( stderr, "%s: no se puede crear\n", out );
+        return 1;
+    }
+    put32( hdr, ANI_MAGIC );
+    put16( hdr + 4, width );
+    put16( hdr + 6, height );
+    put16( hdr + 8, stride );
+    put16( hdr + 10, frames );
+    fwrite( hdr, 1, sizeof(hdr), f );
+    fwrite( spr[0], 1, stride*height, f );
+    total = sizeof(hdr) + stride*height;
+
+    delta = malloc( 4*stride*height + 4 );
+    for( i=0; i<frames; i++ )
+    {
+        size = ani_delta( spr[i], spr[(i+1) % frames], height, stride, (width+1)/2, delta );
+        fwrite( delta, 1, size, f );
+        total += size;
+    }
+    fclose( f );
+
+    printf( "%s: %dx%d, %d frames, %ld bytes (%ld sin deltas)\n", out, width, height, frames, total, (long)(sizeof(hdr) + (long)stride*height*frames) );
+    return 0;
+}
+
+int main( int argc, char *argv[] )
+{
+    uint8_t *spr, *rle;
+    uint8_t hdr[12];
+    long sprSize;
+    uint32_t dstStride;
+    int32_t width, height;
+    int compress;
+    FILE *f;
+
+    if( argc >= 4 && !strcmp( argv[1], "-a" ) )
+        return make_anim( argc-3, argv+3, argv[2] );
+    compress = argc == 4 && !strcmp( argv[1], "-c" );
+    if( compress )
+    {
+        argv++;
+        argc--;
+    }
+    if( argc != 3 )
+    {
+        fprintf( stderr, "uso: %s [-c] fichero.bmp fichero.spr\n", argv[0] );
+        fprintf( stderr, "     %s -a fichero.ani frame0.bmp frame1.bmp ...\n", argv[0] );
+        return 1;
+    }
+    if( !(spr = load_bmp( argv[1], &width, &height, &dstStride )) )
+        return 1;
+
+    put32( hdr, SPR_MAGIC );
+    put16( hdr + 4, width );
+    put16( hdr + 6, height );
+    put16( hdr + 8, dstStride );
+    sprSize = dstStride*height;
+    if( compress )
+    {
+        rle = malloc( sprSize + sprSize/128 + 1 );
+        sprSize = rle_pack( spr, sprSize, rle );
+        free( spr );
+        spr = rle;
+    }
+    put16( hdr + 10, compress ? SPR_RLE : SPR_RAW );
+
+    if( !(f = fopen( argv[2], "wb" )) )
+    {
+        fprintf( stderr, "%s: no se puede crear\n", argv[2] );
+        return 1;
+    }
+    fwrite( hdr, 1, sizeof(hdr), f );
+    fwrite( spr, 1, sprSize, f );
+    fclose( f );
+
+    printf( "%s: %dx%d, %u bytes\n", argv[2], width, height, (unsigned)(sizeof(hdr) + sprSize) );
+    return 0;
+}